@@ -33,6 +33,11 @@ android {
             excludes += "/META-INF/{AL2.0,LGPL2.1}"
         }
     }
+    
+    // models and the dictionary are mapped straight from the apk, keep them stored
+    androidResources {
+        noCompress += listOf("bin", "param", "txt")
+    }
 
     buildTypes {
         release {
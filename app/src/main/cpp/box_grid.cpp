@@ -0,0 +1,143 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "box_grid.h"
+
+#include <algorithm>
+#include <math.h>
+
+BoxGrid::BoxGrid()
+{
+    cell_size = 1.f;
+    cols = 0;
+    rows = 0;
+    stamp = 0;
+}
+
+void BoxGrid::cell_range(const cv::Rect2f& rect, int& x0, int& y0, int& x1, int& y1) const
+{
+    x0 = std::min(std::max((int)floorf((rect.x - origin.x) / cell_size), 0), cols - 1);
+    y0 = std::min(std::max((int)floorf((rect.y - origin.y) / cell_size), 0), rows - 1);
+    x1 = std::min(std::max((int)floorf((rect.x + rect.width - origin.x) / cell_size), 0), cols - 1);
+    y1 = std::min(std::max((int)floorf((rect.y + rect.height - origin.y) / cell_size), 0), rows - 1);
+}
+
+void BoxGrid::build(const std::vector<cv::Rect2f>& _bounds, float _cell_size)
+{
+    bounds = _bounds;
+
+    cols = 0;
+    rows = 0;
+    cell_offsets.clear();
+    cell_boxes.clear();
+    stamps.assign(bounds.size(), 0);
+    stamp = 0;
+
+    if (bounds.empty())
+        return;
+
+    float x0 = bounds[0].x;
+    float y0 = bounds[0].y;
+    float x1 = bounds[0].x + bounds[0].width;
+    float y1 = bounds[0].y + bounds[0].height;
+    float extent = 0.f;
+    for (size_t i = 0; i < bounds.size(); i++)
+    {
+        const cv::Rect2f& r = bounds[i];
+        x0 = std::min(x0, r.x);
+        y0 = std::min(y0, r.y);
+        x1 = std::max(x1, r.x + r.width);
+        y1 = std::max(y1, r.y + r.height);
+        extent += std::max(r.width, r.height);
+    }
+
+    cell_size = _cell_size > 0.f ? _cell_size : extent / bounds.size() * 2;
+    cell_size = std::max(cell_size, 1.f);
+
+    // keep the grid small for sparse huge images
+    const float max_cells = 4096.f;
+    const float grid_area = (x1 - x0) * (y1 - y0);
+    if (grid_area / (cell_size * cell_size) > max_cells)
+        cell_size = sqrtf(grid_area / max_cells);
+
+    origin = cv::Point2f(x0, y0);
+    cols = (int)((x1 - x0) / cell_size) + 1;
+    rows = (int)((y1 - y0) / cell_size) + 1;
+
+    // counting sort of box indexes into cells
+    cell_offsets.assign(cols * rows + 1, 0);
+    for (size_t i = 0; i < bounds.size(); i++)
+    {
+        int cx0, cy0, cx1, cy1;
+        cell_range(bounds[i], cx0, cy0, cx1, cy1);
+        for (int y = cy0; y <= cy1; y++)
+        {
+            for (int x = cx0; x <= cx1; x++)
+            {
+                cell_offsets[y * cols + x + 1]++;
+            }
+        }
+    }
+
+    for (int i = 0; i < cols * rows; i++)
+    {
+        cell_offsets[i + 1] += cell_offsets[i];
+    }
+
+    cell_boxes.resize(cell_offsets[cols * rows]);
+    std::vector<int> cursor(cell_offsets.begin(), cell_offsets.end() - 1);
+    for (size_t i = 0; i < bounds.size(); i++)
+    {
+        int cx0, cy0, cx1, cy1;
+        cell_range(bounds[i], cx0, cy0, cx1, cy1);
+        for (int y = cy0; y <= cy1; y++)
+        {
+            for (int x = cx0; x <= cx1; x++)
+            {
+                cell_boxes[cursor[y * cols + x]++] = (int)i;
+            }
+        }
+    }
+}
+
+void BoxGrid::query(const cv::Rect2f& rect, std::vector<int>& indexes)
+{
+    indexes.clear();
+
+    if (bounds.empty())
+        return;
+
+    stamp++;
+
+    int cx0, cy0, cx1, cy1;
+    cell_range(rect, cx0, cy0, cx1, cy1);
+    for (int y = cy0; y <= cy1; y++)
+    {
+        for (int x = cx0; x <= cx1; x++)
+        {
+            const int cell = y * cols + x;
+            for (int k = cell_offsets[cell]; k < cell_offsets[cell + 1]; k++)
+            {
+                const int i = cell_boxes[k];
+                if (stamps[i] == stamp)
+                    continue;
+
+                stamps[i] = stamp;
+
+                if ((bounds[i] & rect).area() > 0.f)
+                    indexes.push_back(i);
+            }
+        }
+    }
+}
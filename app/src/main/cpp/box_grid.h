@@ -0,0 +1,53 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BOX_GRID_H
+#define BOX_GRID_H
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// uniform grid over axis aligned bounds, for overlap queries between text boxes
+class BoxGrid
+{
+public:
+    BoxGrid();
+
+    // cell_size <= 0 picks twice the mean box extent
+    void build(const std::vector<cv::Rect2f>& bounds, float cell_size = 0.f);
+
+    // boxes whose bounds intersect rect, each reported once
+    void query(const cv::Rect2f& rect, std::vector<int>& indexes);
+
+protected:
+    void cell_range(const cv::Rect2f& rect, int& x0, int& y0, int& x1, int& y1) const;
+
+protected:
+    std::vector<cv::Rect2f> bounds;
+    cv::Point2f origin;
+    float cell_size;
+    int cols;
+    int rows;
+
+    // box indexes bucketed by cell
+    std::vector<int> cell_offsets;
+    std::vector<int> cell_boxes;
+
+    // query dedup stamps
+    std::vector<int> stamps;
+    int stamp;
+};
+
+#endif // BOX_GRID_H
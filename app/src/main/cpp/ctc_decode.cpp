@@ -0,0 +1,151 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ctc_decode.h"
+
+#include <math.h>
+
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif // __ARM_NEON
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+// index of the first maximum
+static int argmax(const float* ptr, int n, float& max_value)
+{
+    int index = 0;
+    float value = ptr[0];
+    int j = 0;
+
+#if __ARM_NEON
+    if (n >= 8)
+    {
+        // per lane maximum and its index, strict compare keeps the first one
+        float32x4_t _max = vld1q_f32(ptr);
+        uint32x4_t _index = {0, 1, 2, 3};
+        uint32x4_t _cur = _index;
+        const uint32x4_t _4 = vdupq_n_u32(4);
+        for (j = 4; j + 3 < n; j += 4)
+        {
+            _cur = vaddq_u32(_cur, _4);
+            float32x4_t _p = vld1q_f32(ptr + j);
+            uint32x4_t _gt = vcgtq_f32(_p, _max);
+            _max = vbslq_f32(_gt, _p, _max);
+            _index = vbslq_u32(_gt, _cur, _index);
+        }
+
+        float lane_max[4];
+        uint32_t lane_index[4];
+        vst1q_f32(lane_max, _max);
+        vst1q_u32(lane_index, _index);
+
+        value = lane_max[0];
+        index = lane_index[0];
+        for (int k = 1; k < 4; k++)
+        {
+            if (lane_max[k] > value || (lane_max[k] == value && (int)lane_index[k] < index))
+            {
+                value = lane_max[k];
+                index = lane_index[k];
+            }
+        }
+    }
+#elif __SSE2__
+    if (n >= 8)
+    {
+        __m128 _max = _mm_loadu_ps(ptr);
+        __m128i _index = _mm_set_epi32(3, 2, 1, 0);
+        __m128i _cur = _index;
+        const __m128i _4 = _mm_set1_epi32(4);
+        for (j = 4; j + 3 < n; j += 4)
+        {
+            _cur = _mm_add_epi32(_cur, _4);
+            __m128 _p = _mm_loadu_ps(ptr + j);
+            __m128 _gt = _mm_cmpgt_ps(_p, _max);
+            __m128i _gti = _mm_castps_si128(_gt);
+            _max = _mm_or_ps(_mm_and_ps(_gt, _p), _mm_andnot_ps(_gt, _max));
+            _index = _mm_or_si128(_mm_and_si128(_gti, _cur), _mm_andnot_si128(_gti, _index));
+        }
+
+        float lane_max[4];
+        int lane_index[4];
+        _mm_storeu_ps(lane_max, _max);
+        _mm_storeu_si128((__m128i*)lane_index, _index);
+
+        value = lane_max[0];
+        index = lane_index[0];
+        for (int k = 1; k < 4; k++)
+        {
+            if (lane_max[k] > value || (lane_max[k] == value && lane_index[k] < index))
+            {
+                value = lane_max[k];
+                index = lane_index[k];
+            }
+        }
+    }
+#endif
+
+    for (; j < n; j++)
+    {
+        if (ptr[j] > value)
+        {
+            value = ptr[j];
+            index = j;
+        }
+    }
+
+    max_value = value;
+    return index;
+}
+
+// softmax of the maximum is 1 / sum(exp(x - max))
+static float max_softmax(const float* ptr, int n, float max_value)
+{
+    float sum = 0.f;
+    for (int j = 0; j < n; j++)
+    {
+        sum += expf(ptr[j] - max_value);
+    }
+    return 1.f / sum;
+}
+
+int ctc_greedy_decode(const ncnn::Mat& logits, int begin, int end, std::vector<int>& ids, std::vector<float>& probs, std::vector<int>* steps)
+{
+    const int w = logits.w;
+
+    // a class is emitted when it differs from the previous step,
+    // a blank in between separates two equal classes
+    int prev = 0;
+    for (int i = begin; i < end; i++)
+    {
+        const float* ptr = logits.row(i);
+
+        float max_value;
+        const int index = argmax(ptr, w, max_value);
+
+        if (index > 0 && index != prev)
+        {
+            ids.push_back(index - 1);
+            probs.push_back(max_softmax(ptr, w, max_value));
+            if (steps)
+                steps->push_back(i);
+        }
+
+        prev = index;
+    }
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CTC_DECODE_H
+#define CTC_DECODE_H
+
+#include <mat.h>
+
+#include <vector>
+
+// greedy ctc decode of rec logits rows [begin, end) taken before the softmax
+// argmax is vectorized, the softmax probability is only computed for emitted classes
+// and repeats are collapsed in one pass, class 0 is the blank
+// ids are appended as class - 1 together with their probabilities, and their rows if steps is given
+int ctc_greedy_decode(const ncnn::Mat& logits, int begin, int end, std::vector<int>& ids, std::vector<float>& probs, std::vector<int>* steps = 0);
+
+#endif // CTC_DECODE_H
@@ -0,0 +1,256 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "db_postprocess.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif // __ARM_NEON
+
+// first x in [x, w) with ptr[x] > threshold, or w
+static int skip_background(const float* ptr, int x, int w, float threshold)
+{
+#if __ARM_NEON
+    float32x4_t _thr = vdupq_n_f32(threshold);
+    for (; x + 3 < w; x += 4)
+    {
+        uint32x4_t _mask = vcgtq_f32(vld1q_f32(ptr + x), _thr);
+        uint32x2_t _mask2 = vorr_u32(vget_low_u32(_mask), vget_high_u32(_mask));
+        if (vget_lane_u32(vpmax_u32(_mask2, _mask2), 0))
+            break;
+    }
+#endif // __ARM_NEON
+    for (; x < w; x++)
+    {
+        if (ptr[x] > threshold)
+            break;
+    }
+    return x;
+}
+
+DBPostProcess::DBPostProcess()
+{
+    growths = 0;
+}
+
+int64_t DBPostProcess::allocations() const
+{
+    return growths;
+}
+
+void DBPostProcess::reset_counters()
+{
+    growths = 0;
+}
+
+size_t DBPostProcess::scratch_capacity() const
+{
+    return runs.capacity() + parents.capacity() + components.capacity() + run_offsets.capacity() + run_order.capacity() + run_cursor.capacity() + regions.capacity() + points.capacity();
+}
+
+int DBPostProcess::find_label(int label)
+{
+    while (parents[label] != label)
+    {
+        parents[label] = parents[parents[label]];
+        label = parents[label];
+    }
+    return label;
+}
+
+void DBPostProcess::union_labels(int a, int b)
+{
+    a = find_label(a);
+    b = find_label(b);
+
+    // the smaller label wins, so regions keep their scan order
+    if (a < b)
+        parents[b] = a;
+    else if (b < a)
+        parents[a] = b;
+}
+
+int DBPostProcess::process(const ncnn::Mat& heatmap, float threshold, float box_thresh, float min_size, int max_candidates, std::vector<DBBox>& boxes)
+{
+    const int w = heatmap.w;
+    const int h = heatmap.h;
+
+    const size_t capacity = scratch_capacity();
+
+    runs.clear();
+    parents.clear();
+
+    // pass over the heatmap, collect runs above threshold
+    // and link them to 8-connected runs on the previous row
+    int prev_begin = 0;
+    int prev_end = 0;
+    for (int y = 0; y < h; y++)
+    {
+        const float* ptr = heatmap.row(y);
+
+        const int row_begin = (int)runs.size();
+
+        int prev = prev_begin;
+        int x = skip_background(ptr, 0, w, threshold);
+        while (x < w)
+        {
+            Run run;
+            run.y = y;
+            run.x0 = x;
+            run.label = -1;
+            while (x < w && ptr[x] > threshold)
+                x++;
+            run.x1 = x - 1;
+
+            // runs above that end before this one can not touch later runs either
+            while (prev < prev_end && runs[prev].x1 < run.x0 - 1)
+                prev++;
+
+            for (int k = prev; k < prev_end && runs[k].x0 <= run.x1 + 1; k++)
+            {
+                if (run.label == -1)
+                    run.label = runs[k].label;
+                else
+                    union_labels(run.label, runs[k].label);
+            }
+
+            if (run.label == -1)
+            {
+                run.label = (int)parents.size();
+                parents.push_back(run.label);
+            }
+
+            runs.push_back(run);
+
+            x = skip_background(ptr, x, w, threshold);
+        }
+
+        prev_begin = row_begin;
+        prev_end = (int)runs.size();
+    }
+
+    // resolve labels into dense region ids in scan order
+    components.assign(parents.size(), -1);
+    int component_count = 0;
+    for (size_t i = 0; i < parents.size(); i++)
+    {
+        int root = find_label(i);
+        if (components[root] == -1)
+            components[root] = component_count++;
+        components[i] = components[root];
+    }
+
+    component_count = std::min(component_count, max_candidates);
+
+    // per region statistics over runs
+    regions.resize(component_count);
+    run_offsets.assign(component_count + 1, 0);
+    for (int i = 0; i < component_count; i++)
+    {
+        regions[i].bbox = cv::Rect();
+        regions[i].area = 0;
+    }
+
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        const Run& run = runs[i];
+        const int c = components[run.label];
+        if (c >= component_count)
+            continue;
+
+        DBBox& region = regions[c];
+        region.bbox |= cv::Rect(run.x0, run.y, run.x1 - run.x0 + 1, 1);
+
+        region.area += run.x1 - run.x0 + 1;
+
+        run_offsets[c + 1]++;
+    }
+
+    // bucket runs by region for the min area rect
+    for (int i = 0; i < component_count; i++)
+    {
+        run_offsets[i + 1] += run_offsets[i];
+    }
+
+    run_order.resize(run_offsets[component_count]);
+    run_cursor.assign(run_offsets.begin(), run_offsets.end() - 1);
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        const int c = components[runs[i].label];
+        if (c >= component_count)
+            continue;
+
+        run_order[run_cursor[c]++] = (int)i;
+    }
+
+    for (int i = 0; i < component_count; i++)
+    {
+        DBBox& region = regions[i];
+
+        // single row or column regions, as contours of two points
+        if (region.bbox.width <= 1 || region.bbox.height <= 1)
+            continue;
+
+        // mean over the outline filled row by row, like the contour fill of the reference
+        // post processing, so the gaps between runs on a row count with their low values
+        // runs of a region are in scan order, left to right within a row
+        float sum = 0.f;
+        int filled = 0;
+        for (int j = run_offsets[i]; j < run_offsets[i + 1];)
+        {
+            const Run& first = runs[run_order[j]];
+            int x1 = first.x1;
+            for (j++; j < run_offsets[i + 1] && runs[run_order[j]].y == first.y; j++)
+                x1 = runs[run_order[j]].x1;
+
+            const float* ptr = heatmap.row(first.y);
+            for (int x = first.x0; x <= x1; x++)
+            {
+                sum += ptr[x];
+            }
+            filled += x1 - first.x0 + 1;
+        }
+
+        region.score = sum / filled;
+        if (region.score < box_thresh)
+            continue;
+
+        // run endpoints are the region outline
+        points.clear();
+        for (int j = run_offsets[i]; j < run_offsets[i + 1]; j++)
+        {
+            const Run& run = runs[run_order[j]];
+            points.push_back(cv::Point2f((float)run.x0, (float)run.y));
+            if (run.x1 != run.x0)
+                points.push_back(cv::Point2f((float)run.x1, (float)run.y));
+        }
+
+        region.rrect = cv::minAreaRect(points);
+
+        float rrect_maxwh = std::max(region.rrect.size.width, region.rrect.size.height);
+        if (rrect_maxwh < min_size)
+            continue;
+
+        boxes.push_back(region);
+    }
+
+    if (scratch_capacity() != capacity)
+        growths++;
+
+    return 0;
+}
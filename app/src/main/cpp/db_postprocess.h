@@ -0,0 +1,78 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DB_POSTPROCESS_H
+#define DB_POSTPROCESS_H
+
+#include <opencv2/core/core.hpp>
+
+#include <mat.h>
+
+#include <stdint.h>
+
+#include <vector>
+
+struct DBBox
+{
+    cv::RotatedRect rrect;
+    cv::Rect bbox;
+    int area;
+    float score;
+};
+
+// DB post processing straight on the float heatmap
+// threshold, 8-connected labeling and per region area / bbox are done in one pass
+// over the map, rows without text cost a compare per pixel
+// the score is the map mean inside the region outline, below threshold pixels included
+class DBPostProcess
+{
+public:
+    DBPostProcess();
+
+    // min_size is the minimum long side of the min area rect in heatmap pixels
+    int process(const ncnn::Mat& heatmap, float threshold, float box_thresh, float min_size, int max_candidates, std::vector<DBBox>& boxes);
+
+    // calls that had to grow the scratch since the last reset_counters()
+    int64_t allocations() const;
+    void reset_counters();
+
+protected:
+    struct Run
+    {
+        int y;
+        int x0;
+        int x1;
+        int label;
+    };
+
+    int find_label(int label);
+    void union_labels(int a, int b);
+
+    size_t scratch_capacity() const;
+
+protected:
+    // scratch kept across calls
+    std::vector<Run> runs;
+    std::vector<int> parents;
+    std::vector<int> components;
+    std::vector<int> run_offsets;
+    std::vector<int> run_order;
+    std::vector<int> run_cursor;
+    std::vector<DBBox> regions;
+    std::vector<cv::Point2f> points;
+
+    int64_t growths;
+};
+
+#endif // DB_POSTPROCESS_H
@@ -21,6 +21,8 @@
 #include <fstream>
 #include <sstream>
 #include <cctype>
+#include <cstring>
+#include <deque>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include "ppocrv5_full.h"
@@ -30,6 +32,9 @@
 
 static PPOCRv5* g_ppocrv5 = nullptr;
 
+// det heatmap of the image being re-thresholded
+static DetectionSession g_det_session;
+
 static std::vector<std::string> load_dict_from_asset(AAssetManager* mgr, const char* filename) {
     std::vector<std::string> dict;
     
@@ -39,222 +44,69 @@ static std::vector<std::string> load_dict_from_asset(AAssetManager* mgr, const c
         return dict;
     }
     
-    size_t size = AAsset_getLength(asset);
-    char* buffer = new char[size + 1];
-    AAsset_read(asset, buffer, size);
-    buffer[size] = '\0';
-    AAsset_close(asset);
+    // lines are cut straight out of the asset buffer, mapped when the asset is stored
+    const char* buffer = (const char*)AAsset_getBuffer(asset);
+    const char* end = buffer + AAsset_getLength(asset);
     
-    std::istringstream iss(buffer);
-    std::string line;
-    while (std::getline(iss, line)) {
-        while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
-            line.pop_back();
+    while (buffer && buffer < end) {
+        const char* line_end = (const char*)memchr(buffer, '\n', end - buffer);
+        if (!line_end) {
+            line_end = end;
         }
-        if (!line.empty()) {
-            dict.push_back(line);
+        
+        const char* text_end = line_end;
+        while (text_end > buffer && text_end[-1] == '\r') {
+            text_end--;
         }
+        if (text_end > buffer) {
+            dict.emplace_back(buffer, text_end);
+        }
+        
+        buffer = line_end + 1;
     }
     
-    delete[] buffer;
+    AAsset_close(asset);
     
     return dict;
 }
 
-extern "C" {
-
-JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
-    return JNI_VERSION_1_6;
-}
-
-JNIEXPORT void JNI_OnUnload(JavaVM* vm, void* reserved) {
-    if (g_ppocrv5 != nullptr) {
-        delete g_ppocrv5;
-        g_ppocrv5 = nullptr;
-    }
-}
-
-JNIEXPORT jboolean JNICALL
-Java_com_tenshi18_droidocr_PPOCRv5Rec_loadModel(
-    JNIEnv* env,
-    jobject thiz,
-    jobject asset_manager,
-    jstring det_param_path,
-    jstring det_bin_path,
-    jstring rec_param_path,
-    jstring rec_bin_path,
-    jstring dict_path,
-    jboolean use_gpu
-) {
-    if (g_ppocrv5 == nullptr) {
-        g_ppocrv5 = new PPOCRv5();
-    }
-    
-    AAssetManager* mgr = AAssetManager_fromJava(env, asset_manager);
-    if (!mgr) {
-        LOGE("Failed to get AssetManager");
-        return JNI_FALSE;
-    }
-    
-    const char* det_param_str = env->GetStringUTFChars(det_param_path, nullptr);
-    const char* det_bin_str = env->GetStringUTFChars(det_bin_path, nullptr);
-    const char* rec_param_str = env->GetStringUTFChars(rec_param_path, nullptr);
-    const char* rec_bin_str = env->GetStringUTFChars(rec_bin_path, nullptr);
-    const char* dict_path_str = env->GetStringUTFChars(dict_path, nullptr);
-    
-    std::vector<std::string> dict = load_dict_from_asset(mgr, dict_path_str);
-    if (dict.empty()) {
-        LOGE("Failed to load dictionary");
-        env->ReleaseStringUTFChars(det_param_path, det_param_str);
-        env->ReleaseStringUTFChars(det_bin_path, det_bin_str);
-        env->ReleaseStringUTFChars(rec_param_path, rec_param_str);
-        env->ReleaseStringUTFChars(rec_bin_path, rec_bin_str);
-        env->ReleaseStringUTFChars(dict_path, dict_path_str);
-        return JNI_FALSE;
-    }
-    
-    int ret = g_ppocrv5->load(
-        mgr,
-        det_param_str,
-        det_bin_str,
-        rec_param_str,
-        rec_bin_str,
-        true,
-        use_gpu
-    );
-    
-    g_ppocrv5->set_dictionary(dict);
-    
-    env->ReleaseStringUTFChars(det_param_path, det_param_str);
-    env->ReleaseStringUTFChars(det_bin_path, det_bin_str);
-    env->ReleaseStringUTFChars(rec_param_path, rec_param_str);
-    env->ReleaseStringUTFChars(rec_bin_path, rec_bin_str);
-    env->ReleaseStringUTFChars(dict_path, dict_path_str);
-    
-    if (ret != 0) {
-        LOGE("Failed to load models");
-        return JNI_FALSE;
-    }
-    
-    g_ppocrv5->set_target_size(1024);
-    
-    return JNI_TRUE;
+static jobjectArray empty_text_regions(JNIEnv* env) {
+    return env->NewObjectArray(0, env->FindClass("com/tenshi18/droidocr/TextRegion"), nullptr);
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_tenshi18_droidocr_PPOCRv5Rec_detectAndRecognize(
-    JNIEnv* env,
-    jobject thiz,
-    jobject bitmap
-) {
-    if (g_ppocrv5 == nullptr) {
-        LOGE("Model not loaded");
-        return env->NewStringUTF("");
-    }
-    
+// locks the bitmap and wraps its rgba pixels, caller unlocks
+static bool lock_rgba_bitmap(JNIEnv* env, jobject bitmap, cv::Mat& rgba) {
     AndroidBitmapInfo info;
     int ret = AndroidBitmap_getInfo(env, bitmap, &info);
     if (ret != ANDROID_BITMAP_RESULT_SUCCESS) {
         LOGE("AndroidBitmap_getInfo failed: %d", ret);
-        return env->NewStringUTF("");
+        return false;
     }
     
     if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
         LOGE("Bitmap format not RGBA_8888");
-        return env->NewStringUTF("");
+        return false;
     }
     
     void* pixels;
     ret = AndroidBitmap_lockPixels(env, bitmap, &pixels);
     if (ret != ANDROID_BITMAP_RESULT_SUCCESS) {
         LOGE("AndroidBitmap_lockPixels failed: %d", ret);
-        return env->NewStringUTF("");
-    }
-    
-    cv::Mat rgba(info.height, info.width, CV_8UC4, pixels);
-    cv::Mat rgb;
-    cv::cvtColor(rgba, rgb, cv::COLOR_RGBA2RGB);
-    
-    std::vector<Object> objects;
-    g_ppocrv5->detect_and_recognize(rgb, objects);
-    
-    AndroidBitmap_unlockPixels(env, bitmap);
-    
-    std::string result;
-    for (size_t i = 0; i < objects.size(); i++) {
-        const Object& obj = objects[i];
-        
-        std::string line;
-        for (size_t j = 0; j < obj.text.size(); j++) {
-            const Character& ch = obj.text[j];
-            const std::string& char_str = g_ppocrv5->get_char(ch.id);
-            
-            if (char_str.empty()) {
-                if (!line.empty() && line.back() != ' ') {
-                    line += " ";
-                }
-                continue;
-            }
-            
-            line += char_str;
-        }
-        
-        if (!line.empty()) {
-            result += line;
-            if (i + 1 < objects.size()) {
-                result += "\n";
-            }
-        }
+        return false;
     }
     
-    return env->NewStringUTF(result.c_str());
+    // ocr reads the locked rgba pixels in place, no full size rgb copy
+    rgba = cv::Mat(info.height, info.width, CV_8UC4, pixels, info.stride);
+    return true;
 }
 
-JNIEXPORT jobjectArray JNICALL
-Java_com_tenshi18_droidocr_PPOCRv5Rec_detectAndRecognizeWithBoxes(
-    JNIEnv* env,
-    jobject thiz,
-    jobject bitmap
-) {
-    if (g_ppocrv5 == nullptr) {
-        LOGE("Model not loaded");
-        return env->NewObjectArray(0, env->FindClass("com/tenshi18/droidocr/TextRegion"), nullptr);
-    }
-    
-    AndroidBitmapInfo info;
-    int ret = AndroidBitmap_getInfo(env, bitmap, &info);
-    if (ret != ANDROID_BITMAP_RESULT_SUCCESS) {
-        LOGE("AndroidBitmap_getInfo failed: %d", ret);
-        return env->NewObjectArray(0, env->FindClass("com/tenshi18/droidocr/TextRegion"), nullptr);
-    }
-    
-    if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
-        LOGE("Bitmap format not RGBA_8888");
-        return env->NewObjectArray(0, env->FindClass("com/tenshi18/droidocr/TextRegion"), nullptr);
-    }
-    
-    void* pixels;
-    ret = AndroidBitmap_lockPixels(env, bitmap, &pixels);
-    if (ret != ANDROID_BITMAP_RESULT_SUCCESS) {
-        LOGE("AndroidBitmap_lockPixels failed: %d", ret);
-        return env->NewObjectArray(0, env->FindClass("com/tenshi18/droidocr/TextRegion"), nullptr);
-    }
-    
-    cv::Mat rgba(info.height, info.width, CV_8UC4, pixels);
-    cv::Mat rgb;
-    cv::cvtColor(rgba, rgb, cv::COLOR_RGBA2RGB);
-    
-    std::vector<Object> objects;
-    g_ppocrv5->detect_and_recognize(rgb, objects);
-    
-    AndroidBitmap_unlockPixels(env, bitmap);
-    
+static jobjectArray make_text_regions(JNIEnv* env, const std::vector<Object>& objects) {
     jclass textRegionClass = env->FindClass("com/tenshi18/droidocr/TextRegion");
     jclass pointFClass = env->FindClass("android/graphics/PointF");
     
     jmethodID textRegionConstructor = env->GetMethodID(
         textRegionClass, "<init>", 
-        "(Ljava/lang/String;[Landroid/graphics/PointF;F)V"
+        "(Ljava/lang/String;[Landroid/graphics/PointF;FZ)V"
     );
     
     jmethodID pointFConstructor = env->GetMethodID(pointFClass, "<init>", "(FF)V");
@@ -386,7 +238,8 @@ Java_com_tenshi18_droidocr_PPOCRv5Rec_detectAndRecognizeWithBoxes(
         
         jstring jtext = env->NewStringUTF(text.c_str());
         jobject textRegion = env->NewObject(textRegionClass, textRegionConstructor,
-                                           jtext, cornersArray, obj.prob);
+                                           jtext, cornersArray, obj.prob,
+                                           obj.skipped ? JNI_TRUE : JNI_FALSE);
         
         env->SetObjectArrayElement(resultArray, i, textRegion);
         
@@ -401,11 +254,124 @@ Java_com_tenshi18_droidocr_PPOCRv5Rec_detectAndRecognizeWithBoxes(
     return resultArray;
 }
 
-JNIEXPORT void JNICALL
-Java_com_tenshi18_droidocr_PPOCRv5Rec_release(
-    JNIEnv* env,
-    jobject thiz
-) {
+// names[index] or "unknown" when index is outside the table
+template<size_t N>
+static const char* stat_name(const char* const (&names)[N], int index) {
+    return index >= 0 && index < (int)N ? names[index] : "unknown";
+}
+
+static std::string format_stats(const OcrStats& stats) {
+    std::ostringstream oss;
+    
+    const double skipped = stats.det_area > 0 ? 100.0 * stats.det_skipped_area / stats.det_area : 0.0;
+    oss << "det_area=" << stats.det_area << "\n";
+    oss << "det_skipped_area=" << stats.det_skipped_area << " (" << skipped << "%)\n";
+    oss << "det_tiles=" << stats.det_tiles << "\n";
+    oss << "det_tiles_skipped=" << stats.det_tiles_skipped << "\n";
+    
+    static const char* const size_reasons[] = {"fixed", "probe", "previous", "no_text"};
+    oss << "det_size=" << stats.det_size << "\n";
+    oss << "det_size_reason=" << stat_name(size_reasons, stats.det_size_reason);
+    if (stats.det_size_clamped < 0) {
+        oss << " (clamped to min)";
+    } else if (stats.det_size_clamped > 0) {
+        oss << " (clamped to max)";
+    }
+    oss << "\n";
+    oss << "det_text_height=" << stats.det_text_height << "\n";
+    
+    oss << "rec_dedup_skipped=" << stats.rec_dedup_skipped << "\n";
+    
+    oss << "det_layers=" << stats.det_layers_before << " -> " << stats.det_layers_after;
+    oss << " (binaryop " << stats.det_binaryops_before << " -> " << stats.det_binaryops_after << ")\n";
+    oss << "rec_layers=" << stats.rec_layers_before << " -> " << stats.rec_layers_after;
+    oss << " (binaryop " << stats.rec_binaryops_before << " -> " << stats.rec_binaryops_after << ")\n";
+    static const char* const precisions[] = {"fp32", "fp16", "int8"};
+    oss << "det_precision=" << stat_name(precisions, stats.det_precision) << " (" << stats.det_model_bytes / 1024 << " KB)\n";
+    oss << "rec_precision=" << stat_name(precisions, stats.rec_precision) << " (" << stats.rec_model_bytes / 1024 << " KB)\n";
+    oss << "det_model_mapped=" << (stats.det_model_mapped ? "true" : "false") << "\n";
+    oss << "rec_model_mapped=" << (stats.rec_model_mapped ? "true" : "false") << "\n";
+    oss << "det_model_cached=" << (stats.det_model_cached ? "true" : "false") << "\n";
+    oss << "rec_model_cached=" << (stats.rec_model_cached ? "true" : "false") << "\n";
+    static const char* const states[] = {"failed", "empty", "loading", "warming", "ready"};
+    oss << "det_state=" << stat_name(states, stats.det_state + 1) << "\n";
+    oss << "rec_state=" << stat_name(states, stats.rec_state + 1) << "\n";
+    oss << "load_time=" << stats.load_time << " ms\n";
+    oss << "rec_ready_time=" << stats.rec_ready_time << " ms\n";
+    oss << "load_peak_rss=" << stats.load_peak_rss << " KB\n";
+    oss << "det_forwards=" << stats.det_forwards << " ("
+        << (stats.det_forwards > 0 ? stats.det_forward_time / stats.det_forwards : 0.0) << " ms)\n";
+    oss << "rec_forwards=" << stats.rec_forwards << " ("
+        << (stats.rec_forwards > 0 ? stats.rec_forward_time / stats.rec_forwards : 0.0) << " ms)\n";
+    
+    oss << "scratch_allocs=" << stats.scratch_allocs << "\n";
+    oss << "scratch_bytes=" << stats.scratch_bytes << "\n";
+    
+    for (size_t i = 0; i < stats.rec_bucket_hits.size(); i++) {
+        const int64_t hits = stats.rec_bucket_hits[i];
+        if (i < stats.rec_bucket_widths.size()) {
+            oss << "rec_bucket_" << stats.rec_bucket_widths[i] << "=";
+        } else {
+            oss << "rec_bucket_unbucketed=";
+        }
+        oss << hits << " (" << (hits > 0 ? stats.rec_bucket_time[i] / hits : 0.0) << " ms)\n";
+    }
+    
+    oss << "rec_packs=" << stats.rec_packs << "\n";
+    oss << "rec_packed_lines=" << stats.rec_packed_lines << "\n";
+    
+    const double step_us = stats.rec_decode_steps > 0 ? 1000.0 * stats.rec_decode_time / stats.rec_decode_steps : 0.0;
+    oss << "rec_decode_time=" << stats.rec_decode_time << " ms\n";
+    oss << "rec_decode_steps=" << stats.rec_decode_steps << " (" << step_us << " us/step)\n";
+    
+    oss << "rec_crop_time=" << stats.rec_crop_time << " ms\n";
+    
+    oss << "rec_parallel_lines=" << stats.rec_parallel_lines << "\n";
+    oss << "rec_threads_per_line=" << stats.rec_threads_per_line << "\n";
+    
+    const int tier_lines = stats.rec_cheap_lines + stats.rec_accurate_lines;
+    if (tier_lines > 0) {
+        oss << "rec_cheap_lines=" << stats.rec_cheap_lines << " (" << stats.rec_cheap_time << " ms)\n";
+        oss << "rec_accurate_lines=" << stats.rec_accurate_lines << " (" << stats.rec_accurate_time << " ms)\n";
+        oss << "rec_time_per_line=" << (stats.rec_cheap_time + stats.rec_accurate_time) / tier_lines << " ms\n";
+    }
+    
+    const int64_t cache_lookups = stats.rec_cache_hits + stats.rec_cache_misses;
+    if (cache_lookups > 0 || stats.rec_cache_entries > 0) {
+        oss << "rec_cache_hits=" << stats.rec_cache_hits << "/" << cache_lookups;
+        if (cache_lookups > 0) {
+            oss << " (" << 100.0 * stats.rec_cache_hits / cache_lookups << "%)";
+        }
+        oss << "\n";
+        oss << "rec_cache_entries=" << stats.rec_cache_entries << " (" << stats.rec_cache_bytes / 1024 << " KB)\n";
+    }
+    
+    if (stats.rec_filter_checked > 0) {
+        oss << "rec_filter_skipped=" << stats.rec_filter_skipped << "/" << stats.rec_filter_checked << "\n";
+    }
+    
+    oss << "rec_chunked_lines=" << stats.rec_chunked_lines << "\n";
+    oss << "rec_chunks=" << stats.rec_chunks << "\n";
+    oss << "rec_chunked_time=" << stats.rec_chunked_time << " ms\n";
+    if (stats.rec_chunk_verified > 0) {
+        oss << "rec_chunk_agreement=" << stats.rec_chunk_agreed << "/" << stats.rec_chunk_verified << "\n";
+        oss << "rec_unchunked_time=" << stats.rec_unchunked_time << " ms";
+        if (stats.rec_unchunked_time > 0.0) {
+            oss << " (" << 100.0 * (1.0 - stats.rec_chunked_time / stats.rec_unchunked_time) << "% saved)";
+        }
+        oss << "\n";
+    }
+    
+    return oss.str();
+}
+
+extern "C" {
+
+JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
+    return JNI_VERSION_1_6;
+}
+
+JNIEXPORT void JNI_OnUnload(JavaVM* vm, void* reserved) {
     if (g_ppocrv5 != nullptr) {
         delete g_ppocrv5;
         g_ppocrv5 = nullptr;
@@ -413,7 +379,7 @@ Java_com_tenshi18_droidocr_PPOCRv5Rec_release(
 }
 
 JNIEXPORT jboolean JNICALL
-Java_com_tenshi18_droidocr_PPOCRv5Rec_switchLanguage(
+Java_com_tenshi18_droidocr_PPOCRv5Rec_loadModel(
     JNIEnv* env,
     jobject thiz,
     jobject asset_manager,
@@ -424,13 +390,10 @@ Java_com_tenshi18_droidocr_PPOCRv5Rec_switchLanguage(
     jstring dict_path,
     jboolean use_gpu
 ) {
-    if (g_ppocrv5 != nullptr) {
-        delete g_ppocrv5;
-        g_ppocrv5 = nullptr;
+    if (g_ppocrv5 == nullptr) {
+        g_ppocrv5 = new PPOCRv5();
     }
     
-    g_ppocrv5 = new PPOCRv5();
-    
     AAssetManager* mgr = AAssetManager_fromJava(env, asset_manager);
     if (!mgr) {
         LOGE("Failed to get AssetManager");
@@ -454,6 +417,10 @@ Java_com_tenshi18_droidocr_PPOCRv5Rec_switchLanguage(
         return JNI_FALSE;
     }
     
+    // rec may finish loading in the background, it needs the dictionary and the canvas size first
+    g_ppocrv5->set_dictionary(dict);
+    g_ppocrv5->set_target_size(1024);
+    
     int ret = g_ppocrv5->load(
         mgr,
         det_param_str,
@@ -464,8 +431,6 @@ Java_com_tenshi18_droidocr_PPOCRv5Rec_switchLanguage(
         use_gpu
     );
     
-    g_ppocrv5->set_dictionary(dict);
-    
     env->ReleaseStringUTFChars(det_param_path, det_param_str);
     env->ReleaseStringUTFChars(det_bin_path, det_bin_str);
     env->ReleaseStringUTFChars(rec_param_path, rec_param_str);
@@ -477,7 +442,650 @@ Java_com_tenshi18_droidocr_PPOCRv5Rec_switchLanguage(
         return JNI_FALSE;
     }
     
-    g_ppocrv5->set_target_size(1024);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_detectAndRecognize(
+    JNIEnv* env,
+    jobject thiz,
+    jobject bitmap
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return env->NewStringUTF("");
+    }
+    
+    cv::Mat rgba;
+    if (!lock_rgba_bitmap(env, bitmap, rgba)) {
+        return env->NewStringUTF("");
+    }
+    
+    std::vector<Object> objects;
+    g_ppocrv5->detect_and_recognize(rgba, objects);
+    
+    AndroidBitmap_unlockPixels(env, bitmap);
+    
+    std::string result;
+    for (size_t i = 0; i < objects.size(); i++) {
+        const Object& obj = objects[i];
+        
+        std::string line;
+        for (size_t j = 0; j < obj.text.size(); j++) {
+            const Character& ch = obj.text[j];
+            const std::string& char_str = g_ppocrv5->get_char(ch.id);
+            
+            if (char_str.empty()) {
+                if (!line.empty() && line.back() != ' ') {
+                    line += " ";
+                }
+                continue;
+            }
+            
+            line += char_str;
+        }
+        
+        if (!line.empty()) {
+            result += line;
+            if (i + 1 < objects.size()) {
+                result += "\n";
+            }
+        }
+    }
+    
+    return env->NewStringUTF(result.c_str());
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_detectAndRecognizeWithBoxes(
+    JNIEnv* env,
+    jobject thiz,
+    jobject bitmap
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return empty_text_regions(env);
+    }
+    
+    cv::Mat rgba;
+    if (!lock_rgba_bitmap(env, bitmap, rgba)) {
+        return empty_text_regions(env);
+    }
+    
+    std::vector<Object> objects;
+    g_ppocrv5->detect_and_recognize(rgba, objects);
+    
+    AndroidBitmap_unlockPixels(env, bitmap);
+    
+    return make_text_regions(env, objects);
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_detectAndRecognizeInRegions(
+    JNIEnv* env,
+    jobject thiz,
+    jobject bitmap,
+    jintArray regions
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return empty_text_regions(env);
+    }
+    
+    // left, top, right, bottom per region, as android.graphics.Rect
+    const jsize count = env->GetArrayLength(regions) / 4;
+    std::vector<jint> coords(count * 4);
+    env->GetIntArrayRegion(regions, 0, count * 4, coords.data());
+    
+    std::vector<cv::Rect> rois;
+    for (jsize i = 0; i < count; i++) {
+        const jint* r = &coords[i * 4];
+        rois.push_back(cv::Rect(r[0], r[1], r[2] - r[0], r[3] - r[1]));
+    }
+    
+    cv::Mat rgba;
+    if (!lock_rgba_bitmap(env, bitmap, rgba)) {
+        return empty_text_regions(env);
+    }
+    
+    std::vector<Object> objects;
+    g_ppocrv5->detect_and_recognize(rgba, rois, objects);
+    
+    AndroidBitmap_unlockPixels(env, bitmap);
+    
+    return make_text_regions(env, objects);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_detectAndRecognizeBatch(
+    JNIEnv* env,
+    jobject thiz,
+    jobject source,
+    jint maxInFlight
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return 0;
+    }
+    
+    jclass sourceClass = env->GetObjectClass(source);
+    jmethodID nextMethod = env->GetMethodID(sourceClass, "next", "()Landroid/graphics/Bitmap;");
+    jmethodID resultMethod = env->GetMethodID(sourceClass, "onResult", "(I[Lcom/tenshi18/droidocr/TextRegion;)V");
+    
+    // locked bitmaps in fetch order, both callbacks run on this thread
+    std::deque<jobject> bitmaps;
+    
+    auto fetch = [&](cv::Mat& rgba) -> bool {
+        if (env->ExceptionCheck()) {
+            return false;
+        }
+        
+        jobject bitmap = env->CallObjectMethod(source, nextMethod);
+        if (env->ExceptionCheck() || bitmap == nullptr) {
+            return false;
+        }
+        
+        if (!lock_rgba_bitmap(env, bitmap, rgba)) {
+            env->DeleteLocalRef(bitmap);
+            return false;
+        }
+        
+        bitmaps.push_back(bitmap);
+        return true;
+    };
+    
+    auto done = [&](int index, std::vector<Object>& objects) {
+        jobject bitmap = bitmaps.front();
+        bitmaps.pop_front();
+        
+        AndroidBitmap_unlockPixels(env, bitmap);
+        env->DeleteLocalRef(bitmap);
+        
+        if (env->ExceptionCheck()) {
+            return;
+        }
+        
+        env->PushLocalFrame(16);
+        env->CallVoidMethod(source, resultMethod, index, make_text_regions(env, objects));
+        env->PopLocalFrame(nullptr);
+    };
+    
+    return g_ppocrv5->detect_and_recognize_pipelined(fetch, done, maxInFlight);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_release(
+    JNIEnv* env,
+    jobject thiz
+) {
+    g_det_session = DetectionSession();
+    
+    if (g_ppocrv5 != nullptr) {
+        delete g_ppocrv5;
+        g_ppocrv5 = nullptr;
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setTiledDetection(
+    JNIEnv* env,
+    jobject thiz,
+    jint tile_size,
+    jint tile_overlap
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_tile_mode(tile_size, tile_overlap);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setCoarseToFine(
+    JNIEnv* env,
+    jobject thiz,
+    jint coarse_size,
+    jint tile_size
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_coarse_to_fine(coarse_size, tile_size);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setAdaptiveDetection(
+    JNIEnv* env,
+    jobject thiz,
+    jint mode,
+    jfloat min_text_height,
+    jint max_size
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_adaptive_target_size(mode, min_text_height, max_size);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setRecognitionWidthBuckets(
+    JNIEnv* env,
+    jobject thiz,
+    jintArray widths
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    std::vector<jint> values(env->GetArrayLength(widths));
+    env->GetIntArrayRegion(widths, 0, (jsize)values.size(), values.data());
+    
+    g_ppocrv5->set_rec_width_buckets(std::vector<int>(values.begin(), values.end()));
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setLinePacking(
+    JNIEnv* env,
+    jobject thiz,
+    jint packWidth,
+    jint maxLineWidth,
+    jint separator
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_line_packing(packWidth, maxLineWidth, separator);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setFastCtcDecode(
+    JNIEnv* env,
+    jobject thiz,
+    jboolean enabled
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_fast_ctc_decode(enabled == JNI_TRUE);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setChunkedRecognition(
+    JNIEnv* env,
+    jobject thiz,
+    jint chunkWidth,
+    jint overlap,
+    jboolean verify
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_rec_chunking(chunkWidth, overlap, verify == JNI_TRUE);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setRecognitionParallelism(
+    JNIEnv* env,
+    jobject thiz,
+    jint mode,
+    jint intraMinWidth
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_rec_parallelism(mode, intraMinWidth);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setCropInterpolation(
+    JNIEnv* env,
+    jobject thiz,
+    jint interpolation
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_rec_crop_interpolation(interpolation);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setTwoTierRecognition(
+    JNIEnv* env,
+    jobject thiz,
+    jboolean enabled,
+    jfloat minProb,
+    jint cheapInterpolation
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_rec_two_tier(enabled == JNI_TRUE, minProb, cheapInterpolation);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setRecognitionCache(
+    JNIEnv* env,
+    jobject thiz,
+    jint maxKilobytes,
+    jint gridStep
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_rec_cache(maxKilobytes > 0 ? (size_t)maxKilobytes * 1024 : 0, gridStep);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setTextFilter(
+    JNIEnv* env,
+    jobject thiz,
+    jboolean enabled,
+    jfloat minContrast,
+    jfloat minEdgeDensity,
+    jfloat maxEdgeDensity
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_text_filter(enabled == JNI_TRUE, minContrast, minEdgeDensity, maxEdgeDensity);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setGraphFusion(
+    JNIEnv* env,
+    jobject thiz,
+    jboolean enabled
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_graph_fusion(enabled == JNI_TRUE);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setModelCacheDir(
+    JNIEnv* env,
+    jobject thiz,
+    jstring path
+) {
+    // called before the first load, so the engine may not exist yet
+    if (g_ppocrv5 == nullptr) {
+        g_ppocrv5 = new PPOCRv5();
+    }
+    
+    const char* path_str = env->GetStringUTFChars(path, nullptr);
+    g_ppocrv5->set_model_cache_dir(path_str);
+    env->ReleaseStringUTFChars(path, path_str);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setModelLoading(
+    JNIEnv* env,
+    jobject thiz,
+    jboolean backgroundRec,
+    jboolean warmUp
+) {
+    // called before the first load, so the engine may not exist yet
+    if (g_ppocrv5 == nullptr) {
+        g_ppocrv5 = new PPOCRv5();
+    }
+    
+    g_ppocrv5->set_model_loading(backgroundRec == JNI_TRUE, warmUp == JNI_TRUE);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_getModelState(
+    JNIEnv* env,
+    jobject thiz,
+    jint net
+) {
+    if (g_ppocrv5 == nullptr) {
+        return PPOCRv5::NET_STATE_EMPTY;
+    }
+    
+    return g_ppocrv5->net_state(net);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setPrecision(
+    JNIEnv* env,
+    jobject thiz,
+    jint detPrecision,
+    jint recPrecision
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_precision(detPrecision, recPrecision);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setDedupOverlap(
+    JNIEnv* env,
+    jobject thiz,
+    jfloat overlap
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    g_ppocrv5->set_dedup_overlap(overlap);
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_getStats(
+    JNIEnv* env,
+    jobject thiz
+) {
+    if (g_ppocrv5 == nullptr) {
+        return env->NewStringUTF("");
+    }
+    
+    return env->NewStringUTF(format_stats(g_ppocrv5->get_stats()).c_str());
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_resetStats(
+    JNIEnv* env,
+    jobject thiz
+) {
+    if (g_ppocrv5 != nullptr) {
+        g_ppocrv5->reset_stats();
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_setDetectionParams(
+    JNIEnv* env,
+    jobject thiz,
+    jfloat threshold,
+    jfloat box_thresh,
+    jfloat enlarge_ratio,
+    jint max_candidates
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return;
+    }
+    
+    DetectionParams params;
+    params.threshold = threshold;
+    params.box_thresh = box_thresh;
+    params.enlarge_ratio = enlarge_ratio;
+    params.max_candidates = max_candidates;
+    g_ppocrv5->set_detection_params(params);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_beginDetectionSession(
+    JNIEnv* env,
+    jobject thiz,
+    jobject bitmap
+) {
+    if (g_ppocrv5 == nullptr) {
+        LOGE("Model not loaded");
+        return JNI_FALSE;
+    }
+    
+    cv::Mat rgba;
+    if (!lock_rgba_bitmap(env, bitmap, rgba)) {
+        return JNI_FALSE;
+    }
+    
+    g_det_session = DetectionSession();
+    
+    std::vector<Object> objects;
+    g_ppocrv5->detect(rgba, g_det_session, objects);
+    
+    AndroidBitmap_unlockPixels(env, bitmap);
+    
+    return g_det_session.heatmap.empty() ? JNI_FALSE : JNI_TRUE;
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_sessionRecognizeWithBoxes(
+    JNIEnv* env,
+    jobject thiz,
+    jobject bitmap,
+    jfloat threshold,
+    jfloat box_thresh,
+    jfloat enlarge_ratio,
+    jint max_candidates
+) {
+    if (g_ppocrv5 == nullptr || g_det_session.heatmap.empty()) {
+        LOGE("No detection session");
+        return empty_text_regions(env);
+    }
+    
+    cv::Mat rgba;
+    if (!lock_rgba_bitmap(env, bitmap, rgba)) {
+        return empty_text_regions(env);
+    }
+    
+    if (rgba.cols != g_det_session.img_w || rgba.rows != g_det_session.img_h) {
+        LOGE("Bitmap does not match the detection session");
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return empty_text_regions(env);
+    }
+    
+    DetectionParams params;
+    params.threshold = threshold;
+    params.box_thresh = box_thresh;
+    params.enlarge_ratio = enlarge_ratio;
+    params.max_candidates = max_candidates;
+    
+    // post processing only, the det net is not run again
+    std::vector<Object> objects;
+    g_ppocrv5->detect(g_det_session, params, objects);
+    g_ppocrv5->dedup(objects);
+    g_ppocrv5->recognize(rgba, objects);
+    
+    AndroidBitmap_unlockPixels(env, bitmap);
+    
+    return make_text_regions(env, objects);
+}
+
+JNIEXPORT void JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_endDetectionSession(
+    JNIEnv* env,
+    jobject thiz
+) {
+    g_det_session = DetectionSession();
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_tenshi18_droidocr_PPOCRv5Rec_switchLanguage(
+    JNIEnv* env,
+    jobject thiz,
+    jobject asset_manager,
+    jstring det_param_path,
+    jstring det_bin_path,
+    jstring rec_param_path,
+    jstring rec_bin_path,
+    jstring dict_path,
+    jboolean use_gpu
+) {
+    g_det_session = DetectionSession();
+    
+    // keep the engine and its settings, load() clears both nets
+    if (g_ppocrv5 == nullptr) {
+        g_ppocrv5 = new PPOCRv5();
+    }
+    
+    AAssetManager* mgr = AAssetManager_fromJava(env, asset_manager);
+    if (!mgr) {
+        LOGE("Failed to get AssetManager");
+        return JNI_FALSE;
+    }
+    
+    const char* det_param_str = env->GetStringUTFChars(det_param_path, nullptr);
+    const char* det_bin_str = env->GetStringUTFChars(det_bin_path, nullptr);
+    const char* rec_param_str = env->GetStringUTFChars(rec_param_path, nullptr);
+    const char* rec_bin_str = env->GetStringUTFChars(rec_bin_path, nullptr);
+    const char* dict_path_str = env->GetStringUTFChars(dict_path, nullptr);
+    
+    std::vector<std::string> dict = load_dict_from_asset(mgr, dict_path_str);
+    if (dict.empty()) {
+        LOGE("Failed to load dictionary");
+        env->ReleaseStringUTFChars(det_param_path, det_param_str);
+        env->ReleaseStringUTFChars(det_bin_path, det_bin_str);
+        env->ReleaseStringUTFChars(rec_param_path, rec_param_str);
+        env->ReleaseStringUTFChars(rec_bin_path, rec_bin_str);
+        env->ReleaseStringUTFChars(dict_path, dict_path_str);
+        return JNI_FALSE;
+    }
+    
+    // rec may finish loading in the background, it needs the dictionary and the canvas size first
+    g_ppocrv5->set_dictionary(dict);
+    g_ppocrv5->set_target_size(1024);
+    
+    int ret = g_ppocrv5->load(
+        mgr,
+        det_param_str,
+        det_bin_str,
+        rec_param_str,
+        rec_bin_str,
+        true,
+        use_gpu
+    );
+    
+    env->ReleaseStringUTFChars(det_param_path, det_param_str);
+    env->ReleaseStringUTFChars(det_bin_path, det_bin_str);
+    env->ReleaseStringUTFChars(rec_param_path, rec_param_str);
+    env->ReleaseStringUTFChars(rec_bin_path, rec_bin_str);
+    env->ReleaseStringUTFChars(dict_path, dict_path_str);
+    
+    if (ret != 0) {
+        LOGE("Failed to load models");
+        return JNI_FALSE;
+    }
     
     return JNI_TRUE;
 }
@@ -0,0 +1,782 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "graph_fusion.h"
+
+#include "mat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <set>
+#include <sstream>
+
+// storage tags in front of a weight blob in the bin
+static const unsigned int tag_fp16 = 0x01306B47;
+static const unsigned int tag_int8 = 0x000D4B38;
+static const unsigned int tag_fp32_scaled = 0x0002C056;
+
+struct ModelWeight
+{
+    // tagged blobs start with a storage tag, untagged ones are plain fp32
+    bool tagged;
+    int count;
+    const unsigned char* raw;
+    size_t raw_size;
+    // fp32 values once decoded, written instead of raw when modified
+    std::vector<float> values;
+    bool decoded;
+    bool modified;
+};
+
+struct ParamLayer
+{
+    std::string type;
+    std::string name;
+    std::vector<std::string> bottoms;
+    std::vector<std::string> tops;
+    // key and value text in param order
+    std::vector<std::pair<int, std::string> > params;
+    std::vector<ModelWeight> weights;
+    bool removed;
+};
+
+static const std::string* find_param(const ParamLayer& layer, int key)
+{
+    for (size_t i = 0; i < layer.params.size(); i++)
+    {
+        if (layer.params[i].first == key)
+            return &layer.params[i].second;
+    }
+
+    return 0;
+}
+
+static int param_int(const ParamLayer& layer, int key, int default_value)
+{
+    const std::string* value = find_param(layer, key);
+    return value ? atoi(value->c_str()) : default_value;
+}
+
+static float param_float(const ParamLayer& layer, int key, float default_value)
+{
+    const std::string* value = find_param(layer, key);
+    return value ? (float)atof(value->c_str()) : default_value;
+}
+
+static void set_param(ParamLayer& layer, int key, const std::string& value)
+{
+    for (size_t i = 0; i < layer.params.size(); i++)
+    {
+        if (layer.params[i].first == key)
+        {
+            layer.params[i].second = value;
+            return;
+        }
+    }
+
+    layer.params.push_back(std::make_pair(key, value));
+}
+
+static std::string float_text(float value)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%e", value);
+    return buf;
+}
+
+static int parse_param(const std::string& param, std::vector<ParamLayer>& layers)
+{
+    std::istringstream in(param);
+
+    int magic = 0;
+    int layer_count = 0;
+    int blob_count = 0;
+    if (!(in >> magic >> layer_count >> blob_count) || magic != 7767517 || layer_count <= 0)
+        return -1;
+
+    layers.resize(layer_count);
+    for (int i = 0; i < layer_count; i++)
+    {
+        ParamLayer& layer = layers[i];
+        layer.removed = false;
+
+        int bottom_count = 0;
+        int top_count = 0;
+        if (!(in >> layer.type >> layer.name >> bottom_count >> top_count))
+            return -1;
+
+        layer.bottoms.resize(bottom_count);
+        for (int j = 0; j < bottom_count; j++)
+        {
+            in >> layer.bottoms[j];
+        }
+
+        layer.tops.resize(top_count);
+        for (int j = 0; j < top_count; j++)
+        {
+            in >> layer.tops[j];
+        }
+
+        std::string rest;
+        std::getline(in, rest);
+
+        std::istringstream tokens(rest);
+        std::string token;
+        while (tokens >> token)
+        {
+            const size_t eq = token.find('=');
+            if (eq == std::string::npos)
+                return -1;
+
+            layer.params.push_back(std::make_pair(atoi(token.substr(0, eq).c_str()), token.substr(eq + 1)));
+        }
+
+        if (!in)
+            return -1;
+    }
+
+    return 0;
+}
+
+// element counts and storage of the weights a layer loads, in load order
+// false for layer types whose weights are not known here
+static bool layer_weight_specs(const ParamLayer& layer, std::vector<std::pair<int, bool> >& specs)
+{
+    const std::string& type = layer.type;
+
+    if (type == "Convolution" || type == "ConvolutionDepthWise")
+    {
+        if (param_int(layer, 8, 0) != 0)
+            return false;
+        if (param_int(layer, 19, 0) != 0)
+            return true;
+
+        specs.push_back(std::make_pair(param_int(layer, 6, 0), true));
+        if (param_int(layer, 5, 0))
+            specs.push_back(std::make_pair(param_int(layer, 0, 0), false));
+        return true;
+    }
+
+    if (type == "Deconvolution" || type == "DeconvolutionDepthWise")
+    {
+        if (param_int(layer, 28, 0) != 0)
+            return true;
+
+        specs.push_back(std::make_pair(param_int(layer, 6, 0), true));
+        if (param_int(layer, 5, 0))
+            specs.push_back(std::make_pair(param_int(layer, 0, 0), false));
+        return true;
+    }
+
+    if (type == "InnerProduct")
+    {
+        if (param_int(layer, 8, 0) != 0)
+            return false;
+
+        specs.push_back(std::make_pair(param_int(layer, 2, 0), true));
+        if (param_int(layer, 1, 0))
+            specs.push_back(std::make_pair(param_int(layer, 0, 0), false));
+        return true;
+    }
+
+    if (type == "BatchNorm")
+    {
+        // slope, mean, var and bias
+        for (int i = 0; i < 4; i++)
+        {
+            specs.push_back(std::make_pair(param_int(layer, 0, 0), false));
+        }
+        return true;
+    }
+
+    if (type == "LayerNorm")
+    {
+        if (param_int(layer, 2, 1))
+        {
+            specs.push_back(std::make_pair(param_int(layer, 0, 0), false));
+            specs.push_back(std::make_pair(param_int(layer, 0, 0), false));
+        }
+        return true;
+    }
+
+    if (type == "MultiHeadAttention")
+    {
+        if (param_int(layer, 18, 0) != 0)
+            return false;
+
+        const int embed_dim = param_int(layer, 0, 0);
+        if (embed_dim <= 0)
+            return false;
+
+        const int qdim = param_int(layer, 2, 0) / embed_dim;
+        const int kdim = param_int(layer, 3, embed_dim);
+        const int vdim = param_int(layer, 4, embed_dim);
+
+        specs.push_back(std::make_pair(embed_dim * qdim, true));
+        specs.push_back(std::make_pair(embed_dim, false));
+        specs.push_back(std::make_pair(embed_dim * kdim, true));
+        specs.push_back(std::make_pair(embed_dim, false));
+        specs.push_back(std::make_pair(embed_dim * vdim, true));
+        specs.push_back(std::make_pair(embed_dim, false));
+        specs.push_back(std::make_pair(qdim * embed_dim, true));
+        specs.push_back(std::make_pair(qdim, false));
+        return true;
+    }
+
+    if (type == "Gemm")
+    {
+        if (param_int(layer, 18, 0) != 0)
+            return false;
+
+        const int M = param_int(layer, 7, 0);
+        const int N = param_int(layer, 8, 0);
+        const int K = param_int(layer, 9, 0);
+
+        if (param_int(layer, 4, 0))
+            specs.push_back(std::make_pair(M * K, true));
+        if (param_int(layer, 5, 0))
+            specs.push_back(std::make_pair(N * K, true));
+
+        const int broadcast_type_C = param_int(layer, 10, 0);
+        if (param_int(layer, 6, 0) && broadcast_type_C != -1)
+        {
+            const int sizes[5] = {1, M, M, M * N, N};
+            if (broadcast_type_C < 0 || broadcast_type_C > 4)
+                return false;
+            specs.push_back(std::make_pair(sizes[broadcast_type_C], true));
+        }
+        return true;
+    }
+
+    static const char* const weightless[] = {
+        "Input", "Split", "Concat", "Slice", "Crop", "BinaryOp", "UnaryOp", "Eltwise",
+        "ReLU", "Clip", "Sigmoid", "HardSigmoid", "HardSwish", "Swish", "Mish", "GELU", "TanH",
+        "Pooling", "Interp", "Reshape", "Permute", "Flatten", "Squeeze", "ExpandDims",
+        "Softmax", "Dropout", "Noop"
+    };
+    for (size_t i = 0; i < sizeof(weightless) / sizeof(weightless[0]); i++)
+    {
+        if (type == weightless[i])
+            return true;
+    }
+
+    return false;
+}
+
+static bool read_weight(const unsigned char*& ptr, const unsigned char* end, int count, bool tagged, ModelWeight& weight)
+{
+    weight.tagged = tagged;
+    weight.count = count;
+    weight.raw = ptr;
+    weight.decoded = false;
+    weight.modified = false;
+
+    size_t size = (size_t)count * sizeof(float);
+    if (tagged)
+    {
+        if (end - ptr < 4)
+            return false;
+
+        unsigned int tag;
+        memcpy(&tag, ptr, 4);
+
+        const size_t aligned_count = ((size_t)count + 3) / 4 * 4;
+        if (tag == tag_fp16)
+            size = 4 + ((size_t)count * 2 + 3) / 4 * 4;
+        else if (tag == tag_int8)
+            size = 4 + aligned_count;
+        else if (tag == tag_fp32_scaled || tag == 0)
+            size = 4 + (size_t)count * sizeof(float);
+        else
+            // uint8 indices into a 256 entry table
+            size = 4 + 256 * sizeof(float) + aligned_count;
+    }
+
+    if ((size_t)(end - ptr) < size)
+        return false;
+
+    weight.raw_size = size;
+    ptr += size;
+    return true;
+}
+
+// fp32 values of an fp32 or fp16 weight, false for quantized storage
+static bool decode_weight(ModelWeight& weight)
+{
+    if (weight.decoded)
+        return true;
+
+    weight.values.resize(weight.count);
+
+    unsigned int tag = 0;
+    const unsigned char* data = weight.raw;
+    if (weight.tagged)
+    {
+        memcpy(&tag, weight.raw, 4);
+        data += 4;
+    }
+
+    if (tag == 0)
+    {
+        memcpy(weight.values.data(), data, weight.count * sizeof(float));
+    }
+    else if (tag == tag_fp16)
+    {
+        for (int i = 0; i < weight.count; i++)
+        {
+            unsigned short half;
+            memcpy(&half, data + i * 2, 2);
+            weight.values[i] = ncnn::float16_to_float32(half);
+        }
+    }
+    else
+    {
+        weight.values.clear();
+        return false;
+    }
+
+    weight.decoded = true;
+    return true;
+}
+
+static bool decodable(const ModelWeight& weight)
+{
+    if (!weight.tagged || weight.decoded)
+        return true;
+
+    unsigned int tag;
+    memcpy(&tag, weight.raw, 4);
+    return tag == 0 || tag == tag_fp16;
+}
+
+// y = a * x + b of a BinaryOp with a scalar operand
+static bool scalar_affine(const ParamLayer& layer, float& a, float& b)
+{
+    if (layer.removed || layer.type != "BinaryOp" || layer.bottoms.size() != 1 || layer.tops.size() != 1)
+        return false;
+    if (param_int(layer, 1, 0) != 1)
+        return false;
+
+    const float c = param_float(layer, 2, 0.f);
+    switch (param_int(layer, 0, 0))
+    {
+    case 0:
+        a = 1.f;
+        b = c;
+        return true;
+    case 1:
+        a = 1.f;
+        b = -c;
+        return true;
+    case 2:
+        a = c;
+        b = 0.f;
+        return true;
+    case 3:
+        if (c == 0.f)
+            return false;
+        a = 1.f / c;
+        b = 0.f;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// weights and bias of a conv, a zero bias is added when it has none
+static bool conv_weights(ParamLayer& layer, ModelWeight*& weight, ModelWeight*& bias)
+{
+    const int num_output = param_int(layer, 0, 0);
+    if (layer.weights.empty() || num_output <= 0 || layer.weights[0].count % num_output != 0)
+        return false;
+    if (!decode_weight(layer.weights[0]))
+        return false;
+
+    if (layer.weights.size() == 1)
+    {
+        ModelWeight zero;
+        zero.tagged = false;
+        zero.count = num_output;
+        zero.raw = 0;
+        zero.raw_size = 0;
+        zero.values.assign(num_output, 0.f);
+        zero.decoded = true;
+        zero.modified = true;
+        layer.weights.push_back(zero);
+
+        set_param(layer, 5, "1");
+    }
+    else if (!decode_weight(layer.weights[1]))
+    {
+        return false;
+    }
+
+    weight = &layer.weights[0];
+    bias = &layer.weights[1];
+    return true;
+}
+
+// a * conv(x) + b
+static bool fold_into_producer(ParamLayer& layer, float a, float b)
+{
+    const bool conv = layer.type == "Convolution" || layer.type == "ConvolutionDepthWise";
+    const bool deconv = layer.type == "Deconvolution" || layer.type == "DeconvolutionDepthWise";
+    if (!conv && !deconv)
+        return false;
+
+    // an activation sits between the conv and the affine
+    if (param_int(layer, 9, 0) != 0)
+        return false;
+
+    ModelWeight* weight;
+    ModelWeight* bias;
+    if (!conv_weights(layer, weight, bias))
+        return false;
+
+    for (int i = 0; i < weight->count; i++)
+    {
+        weight->values[i] *= a;
+    }
+    for (int i = 0; i < bias->count; i++)
+    {
+        bias->values[i] = bias->values[i] * a + b;
+    }
+
+    weight->modified = true;
+    bias->modified = true;
+    return true;
+}
+
+static bool can_fold_into_consumer(const ParamLayer& layer, float a)
+{
+    if (layer.type != "Convolution" && layer.type != "ConvolutionDepthWise")
+        return false;
+    if (layer.bottoms.size() != 1 || layer.weights.empty() || a == 0.f)
+        return false;
+
+    for (size_t i = 0; i < layer.weights.size(); i++)
+    {
+        if (!decodable(layer.weights[i]))
+            return false;
+    }
+
+    const int num_output = param_int(layer, 0, 0);
+    return num_output > 0 && layer.weights[0].count % num_output == 0;
+}
+
+// conv(a * x + b)
+static bool fold_into_consumer(ParamLayer& layer, float a, float b)
+{
+    if (!can_fold_into_consumer(layer, a))
+        return false;
+
+    ModelWeight* weight;
+    ModelWeight* bias;
+    if (!conv_weights(layer, weight, bias))
+        return false;
+
+    // every output sees b through its whole kernel
+    const int num_output = param_int(layer, 0, 0);
+    const int kernel_size = weight->count / num_output;
+    for (int p = 0; p < num_output; p++)
+    {
+        float* w = &weight->values[p * kernel_size];
+
+        double sum = 0.0;
+        for (int k = 0; k < kernel_size; k++)
+        {
+            sum += w[k];
+            w[k] *= a;
+        }
+
+        bias->values[p] += (float)(b * sum);
+    }
+
+    weight->modified = true;
+    bias->modified = true;
+
+    // padding has to stay what the conv saw before, a * pad + b = old pad value
+    const int pad_left = param_int(layer, 4, 0);
+    const int pad_right = param_int(layer, 15, pad_left);
+    const int pad_top = param_int(layer, 14, pad_left);
+    const int pad_bottom = param_int(layer, 16, pad_top);
+    if (pad_left != 0 || pad_right != 0 || pad_top != 0 || pad_bottom != 0)
+    {
+        const float pad_value = param_float(layer, 18, 0.f);
+        set_param(layer, 18, float_text((pad_value - b) / a));
+    }
+
+    return true;
+}
+
+// hardsigmoid(a * x + b)
+static bool fold_into_activation(ParamLayer& layer, float a, float b)
+{
+    if (layer.type != "HardSigmoid")
+        return false;
+
+    const float alpha = param_float(layer, 0, 0.2f);
+    const float beta = param_float(layer, 1, 0.5f);
+
+    set_param(layer, 0, float_text(alpha * a));
+    set_param(layer, 1, float_text(alpha * b + beta));
+    return true;
+}
+
+// split(a * x + b) where every branch is a conv
+static bool fold_through_split(std::vector<ParamLayer>& layers, const ParamLayer& split, std::map<std::string, std::vector<int> >& consumers, float a, float b)
+{
+    if (split.type != "Split")
+        return false;
+
+    for (size_t i = 0; i < split.tops.size(); i++)
+    {
+        const std::vector<int>& next = consumers[split.tops[i]];
+        if (next.size() != 1 || !can_fold_into_consumer(layers[next[0]], a))
+            return false;
+    }
+
+    for (size_t i = 0; i < split.tops.size(); i++)
+    {
+        fold_into_consumer(layers[consumers[split.tops[i]][0]], a, b);
+    }
+
+    return true;
+}
+
+static void write_param(const std::vector<ParamLayer>& layers, std::string& param)
+{
+    int layer_count = 0;
+    std::set<std::string> blobs;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (layers[i].removed)
+            continue;
+
+        layer_count++;
+        blobs.insert(layers[i].tops.begin(), layers[i].tops.end());
+    }
+
+    std::ostringstream out;
+    out << "7767517\n" << layer_count << " " << blobs.size() << "\n";
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const ParamLayer& layer = layers[i];
+        if (layer.removed)
+            continue;
+
+        char head[128];
+        snprintf(head, sizeof(head), "%-24s %-24s %d %d", layer.type.c_str(), layer.name.c_str(), (int)layer.bottoms.size(), (int)layer.tops.size());
+        out << head;
+
+        for (size_t j = 0; j < layer.bottoms.size(); j++)
+        {
+            out << " " << layer.bottoms[j];
+        }
+        for (size_t j = 0; j < layer.tops.size(); j++)
+        {
+            out << " " << layer.tops[j];
+        }
+        for (size_t j = 0; j < layer.params.size(); j++)
+        {
+            out << " " << layer.params[j].first << "=" << layer.params[j].second;
+        }
+        out << "\n";
+    }
+
+    param = out.str();
+}
+
+static void write_model(const std::vector<ParamLayer>& layers, std::vector<unsigned char>& model)
+{
+    model.clear();
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (layers[i].removed)
+            continue;
+
+        for (size_t j = 0; j < layers[i].weights.size(); j++)
+        {
+            const ModelWeight& weight = layers[i].weights[j];
+            if (!weight.modified)
+            {
+                model.insert(model.end(), weight.raw, weight.raw + weight.raw_size);
+                continue;
+            }
+
+            if (weight.tagged)
+            {
+                const unsigned int tag = 0;
+                const unsigned char* p = (const unsigned char*)&tag;
+                model.insert(model.end(), p, p + 4);
+            }
+
+            const unsigned char* p = (const unsigned char*)weight.values.data();
+            model.insert(model.end(), p, p + weight.count * sizeof(float));
+        }
+    }
+}
+
+int fuse_scalar_affine(const std::string& param, const unsigned char* model, size_t model_size, std::string& fused_param, std::vector<unsigned char>& fused_model, GraphFusionReport* report, bool fp32_weights)
+{
+    std::vector<ParamLayer> layers;
+    if (parse_param(param, layers) != 0)
+        return -1;
+
+    // every layer has to be walked for the weights of the later ones to line up
+    const unsigned char* ptr = model;
+    const unsigned char* end = model + model_size;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        std::vector<std::pair<int, bool> > specs;
+        if (!layer_weight_specs(layers[i], specs))
+            return -1;
+
+        layers[i].weights.resize(specs.size());
+        for (size_t j = 0; j < specs.size(); j++)
+        {
+            if (!read_weight(ptr, end, specs[j].first, specs[j].second, layers[i].weights[j]))
+                return -1;
+        }
+    }
+
+    if (ptr != end)
+        return -1;
+
+    GraphFusionReport r;
+    r.layers_before = (int)layers.size();
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        r.binaryops_before += layers[i].type == "BinaryOp" ? 1 : 0;
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+
+        std::map<std::string, int> producer;
+        std::map<std::string, std::vector<int> > consumers;
+        for (int i = 0; i < (int)layers.size(); i++)
+        {
+            if (layers[i].removed)
+                continue;
+
+            for (size_t j = 0; j < layers[i].tops.size(); j++)
+            {
+                producer[layers[i].tops[j]] = i;
+            }
+            for (size_t j = 0; j < layers[i].bottoms.size(); j++)
+            {
+                consumers[layers[i].bottoms[j]].push_back(i);
+            }
+        }
+
+        for (int i = 0; i < (int)layers.size() && !changed; i++)
+        {
+            float a;
+            float b;
+            if (!scalar_affine(layers[i], a, b))
+                continue;
+
+            const std::string& x = layers[i].bottoms[0];
+
+            // start at the head of a chain only
+            std::map<std::string, int>::const_iterator p = producer.find(x);
+            float pa;
+            float pb;
+            if (p != producer.end() && consumers[x].size() == 1 && scalar_affine(layers[p->second], pa, pb))
+                continue;
+
+            std::vector<int> chain(1, i);
+            for (;;)
+            {
+                const std::vector<int>& next = consumers[layers[chain.back()].tops[0]];
+                float na;
+                float nb;
+                if (next.size() != 1 || !scalar_affine(layers[next[0]], na, nb))
+                    break;
+
+                chain.push_back(next[0]);
+                a = na * a;
+                b = na * b + nb;
+            }
+
+            const std::string y = layers[chain.back()].tops[0];
+
+            bool folded = false;
+            if (p != producer.end() && consumers[x].size() == 1 && fold_into_producer(layers[p->second], a, b))
+            {
+                layers[p->second].tops[0] = y;
+                r.folded_into_producer++;
+                folded = true;
+            }
+            else if (consumers[y].size() == 1)
+            {
+                ParamLayer& next = layers[consumers[y][0]];
+                if (fold_into_consumer(next, a, b) || fold_through_split(layers, next, consumers, a, b))
+                    r.folded_into_consumer++;
+                else if (fold_into_activation(next, a, b))
+                    r.folded_into_activation++;
+                else
+                    continue;
+
+                for (size_t j = 0; j < next.bottoms.size(); j++)
+                {
+                    if (next.bottoms[j] == y)
+                        next.bottoms[j] = x;
+                }
+                folded = true;
+            }
+
+            if (!folded)
+                continue;
+
+            for (size_t j = 0; j < chain.size(); j++)
+            {
+                layers[chain[j]].removed = true;
+            }
+            changed = true;
+        }
+    }
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (layers[i].removed)
+            continue;
+
+        r.layers_after++;
+        r.binaryops_after += layers[i].type == "BinaryOp" ? 1 : 0;
+
+        for (size_t j = 0; fp32_weights && j < layers[i].weights.size(); j++)
+        {
+            ModelWeight& weight = layers[i].weights[j];
+            if (weight.tagged && !weight.modified && decodable(weight) && decode_weight(weight))
+                weight.modified = true;
+        }
+    }
+
+    write_param(layers, fused_param);
+    write_model(layers, fused_model);
+
+    if (report)
+        *report = r;
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef GRAPH_FUSION_H
+#define GRAPH_FUSION_H
+
+#include <string>
+#include <vector>
+
+struct GraphFusionReport
+{
+    int layers_before;
+    int layers_after;
+    int binaryops_before;
+    int binaryops_after;
+    // scalar affine chains folded into the producing conv, the consuming conv
+    // and the following HardSigmoid
+    int folded_into_producer;
+    int folded_into_consumer;
+    int folded_into_activation;
+
+    GraphFusionReport()
+        : layers_before(0), layers_after(0), binaryops_before(0), binaryops_after(0),
+          folded_into_producer(0), folded_into_consumer(0), folded_into_activation(0)
+    {
+    }
+};
+
+// fold chains of scalar BinaryOp add, sub, mul and div into the neighbouring layers
+// a * x + b after a conv without activation goes into its weights and bias
+// a * x + b in front of a conv goes into its weights and bias, with the pad value moved to
+// where a * pad + b is the old pad value, also for every branch of a Split,
+// in front of a HardSigmoid it goes into alpha and beta
+// param is the plain text param and model its bin, folded weights are written as fp32,
+// with fp32_weights every fp16 weight is expanded too so ncnn can reference them in place
+// returns 0 with the slimmer pair, -1 when the param or the bin can not be walked
+int fuse_scalar_affine(const std::string& param, const unsigned char* model, size_t model_size, std::string& fused_param, std::vector<unsigned char>& fused_model, GraphFusionReport* report = 0, bool fp32_weights = false);
+
+#endif // GRAPH_FUSION_H
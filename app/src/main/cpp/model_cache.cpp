@@ -0,0 +1,142 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "model_cache.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bumped whenever the fused layout changes
+static const uint64_t cache_format = 1;
+
+static std::string cache_name(const std::string& name)
+{
+    // models are named by their path, only the file name is kept
+    const size_t slash = name.rfind('/');
+    return slash == std::string::npos ? name : name.substr(slash + 1);
+}
+
+static bool write_file(const std::string& path, const void* data, size_t size)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+
+    const bool ok = fwrite(data, 1, size, fp) == size;
+    return fclose(fp) == 0 && ok;
+}
+
+void ModelCache::set_dir(const std::string& path)
+{
+    dir = path;
+    while (dir.size() > 1 && dir[dir.size() - 1] == '/')
+        dir.erase(dir.size() - 1);
+}
+
+bool ModelCache::enabled() const
+{
+    return !dir.empty();
+}
+
+uint64_t ModelCache::model_key(const std::string& param, const unsigned char* model, size_t model_size)
+{
+    // fnv-1a over 8 byte words, the tail a byte at a time
+    const uint64_t prime = 1099511628211ull;
+    uint64_t h = 14695981039346656037ull ^ cache_format;
+
+    const unsigned char* parts[2] = {(const unsigned char*)param.data(), model};
+    const size_t sizes[2] = {param.size(), model_size};
+    for (int k = 0; k < 2; k++)
+    {
+        const unsigned char* p = parts[k];
+        size_t i = 0;
+        for (; i + 8 <= sizes[k]; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, p + i, 8);
+            h = (h ^ word) * prime;
+        }
+        for (; i < sizes[k]; i++)
+        {
+            h = (h ^ p[i]) * prime;
+        }
+
+        h = (h ^ sizes[k]) * prime;
+    }
+
+    return h;
+}
+
+std::string ModelCache::entry_path(const std::string& name, uint64_t key, const char* ext) const
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%016llx.%s", (unsigned long long)key, ext);
+    return dir + "/" + cache_name(name) + suffix;
+}
+
+int ModelCache::open(const std::string& name, uint64_t key, std::string& param, ModelMapping& model) const
+{
+    if (!enabled())
+        return -1;
+
+    ModelMapping param_mapping;
+    if (param_mapping.open_file(entry_path(name, key, "param").c_str()) != 0)
+        return -1;
+
+    if (model.open_file(entry_path(name, key, "bin").c_str()) != 0)
+        return -1;
+
+    param.assign((const char*)param_mapping.data(), param_mapping.size());
+    return 0;
+}
+
+int ModelCache::store(const std::string& name, uint64_t key, const std::string& param, const std::vector<unsigned char>& model) const
+{
+    if (!enabled())
+        return -1;
+
+    mkdir(dir.c_str(), 0700);
+
+    // entries of older versions of this model
+    const std::string prefix = cache_name(name) + ".";
+    DIR* d = opendir(dir.c_str());
+    if (d)
+    {
+        struct dirent* entry;
+        while ((entry = readdir(d)) != 0)
+        {
+            if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0)
+                unlink((dir + "/" + entry->d_name).c_str());
+        }
+        closedir(d);
+    }
+
+    // the bin goes in first and the param last, a param always has its bin
+    // and a half written file never carries the final name
+    const std::string bin_path = entry_path(name, key, "bin");
+    const std::string param_path = entry_path(name, key, "param");
+    if (!write_file(bin_path + ".tmp", model.data(), model.size()) || rename((bin_path + ".tmp").c_str(), bin_path.c_str()) != 0
+            || !write_file(param_path + ".tmp", param.data(), param.size()) || rename((param_path + ".tmp").c_str(), param_path.c_str()) != 0)
+    {
+        unlink((bin_path + ".tmp").c_str());
+        unlink((param_path + ".tmp").c_str());
+        unlink(bin_path.c_str());
+        return -1;
+    }
+
+    return 0;
+}
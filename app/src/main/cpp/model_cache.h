@@ -0,0 +1,50 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include "model_mapping.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// fused models kept in app private storage between launches
+// entries are keyed by the hash of the source param and bin, a changed model
+// or fusion format gets a new entry and the stale one of the same name is removed
+class ModelCache
+{
+public:
+    // empty dir disables the cache
+    void set_dir(const std::string& dir);
+    bool enabled() const;
+
+    // key of a source param and bin
+    static uint64_t model_key(const std::string& param, const unsigned char* model, size_t model_size);
+
+    // cached param text and mapped bin of name, 0 on a hit
+    int open(const std::string& name, uint64_t key, std::string& param, ModelMapping& model) const;
+
+    // write an entry, 0 on success
+    int store(const std::string& name, uint64_t key, const std::string& param, const std::vector<unsigned char>& model) const;
+
+private:
+    std::string entry_path(const std::string& name, uint64_t key, const char* ext) const;
+
+    std::string dir;
+};
+
+#endif // MODEL_CACHE_H
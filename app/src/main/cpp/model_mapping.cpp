@@ -0,0 +1,131 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "model_mapping.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+ModelMapping::ModelMapping()
+    : map_addr(0), map_size(0), asset(0), bytes(0), byte_count(0), is_mapped(false)
+{
+}
+
+ModelMapping::~ModelMapping()
+{
+    close();
+}
+
+int ModelMapping::open_file(const char* path)
+{
+    close();
+
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    void* addr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return -1;
+
+    // every page is read right away while loading
+    madvise(addr, st.st_size, MADV_WILLNEED);
+
+    map_addr = addr;
+    map_size = st.st_size;
+    bytes = (const unsigned char*)addr;
+    byte_count = map_size;
+    is_mapped = true;
+    return 0;
+}
+
+int ModelMapping::open_asset(AAssetManager* mgr, const char* path)
+{
+    close();
+
+    asset = AAssetManager_open(mgr, path, AASSET_MODE_BUFFER);
+    if (!asset)
+        return -1;
+
+    // stored assets are mmapped from the apk, compressed ones get inflated into the heap
+    bytes = (const unsigned char*)AAsset_getBuffer(asset);
+    byte_count = AAsset_getLength(asset);
+    if (!bytes || byte_count == 0)
+    {
+        close();
+        return -1;
+    }
+
+    is_mapped = !AAsset_isAllocated(asset);
+    return 0;
+}
+
+void ModelMapping::close()
+{
+    if (map_addr)
+        munmap(map_addr, map_size);
+
+    if (asset)
+        AAsset_close(asset);
+
+    map_addr = 0;
+    map_size = 0;
+    asset = 0;
+    bytes = 0;
+    byte_count = 0;
+    is_mapped = false;
+}
+
+void ModelMapping::swap(ModelMapping& other)
+{
+    std::swap(map_addr, other.map_addr);
+    std::swap(map_size, other.map_size);
+    std::swap(asset, other.asset);
+    std::swap(bytes, other.bytes);
+    std::swap(byte_count, other.byte_count);
+    std::swap(is_mapped, other.is_mapped);
+}
+
+const unsigned char* ModelMapping::data() const
+{
+    return bytes;
+}
+
+size_t ModelMapping::size() const
+{
+    return byte_count;
+}
+
+bool ModelMapping::mapped() const
+{
+    return is_mapped;
+}
+
+bool ModelMapping::aligned() const
+{
+    return ((uintptr_t)bytes & 3) == 0;
+}
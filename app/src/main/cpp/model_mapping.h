@@ -0,0 +1,60 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MODEL_MAPPING_H
+#define MODEL_MAPPING_H
+
+#include <android/asset_manager.h>
+
+#include <stddef.h>
+
+// read only view of a model file, mapped from the page cache when possible
+// uncompressed apk assets and plain files are not copied, the mapping is shared
+// with every process reading the same file
+class ModelMapping
+{
+public:
+    ModelMapping();
+    ~ModelMapping();
+
+    // 0 on success, the previous mapping is closed first
+    int open_file(const char* path);
+    int open_asset(AAssetManager* mgr, const char* path);
+
+    void close();
+
+    void swap(ModelMapping& other);
+
+    const unsigned char* data() const;
+    size_t size() const;
+
+    // false when the bytes had to be inflated or read into the heap
+    bool mapped() const;
+
+    // 32 bit aligned, ncnn can reference weights in place
+    bool aligned() const;
+
+private:
+    ModelMapping(const ModelMapping&);
+    ModelMapping& operator=(const ModelMapping&);
+
+    void* map_addr;
+    size_t map_size;
+    AAsset* asset;
+    const unsigned char* bytes;
+    size_t byte_count;
+    bool is_mapped;
+};
+
+#endif // MODEL_MAPPING_H
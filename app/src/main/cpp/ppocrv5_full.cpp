@@ -14,7 +14,19 @@
 
 #include "ppocrv5_full.h"
 
+#include "box_grid.h"
+#include "ctc_decode.h"
+#include "db_postprocess.h"
+#include "graph_fusion.h"
+#include "model_cache.h"
+#include "model_mapping.h"
+#include "preprocess.h"
+#include "scratch_arena.h"
+#include "task_pool.h"
+
+#include "benchmark.h"
 #include "cpu.h"
+#include "datareader.h"
 #include "net.h"
 
 #include <opencv2/core/core.hpp>
@@ -22,6 +34,13 @@
 
 #include <android/log.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #define TAG "PPOCRv5Full"
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
 
@@ -33,40 +52,11 @@ static cv::Mat denoise_image(const cv::Mat& rgb)
     return denoised;
 }
 
-static double contour_score(const cv::Mat& binary, const std::vector<cv::Point>& contour)
-{
-    cv::Rect rect = cv::boundingRect(contour);
-    if (rect.x < 0)
-        rect.x = 0;
-    if (rect.y < 0)
-        rect.y = 0;
-    if (rect.x + rect.width > binary.cols)
-        rect.width = binary.cols - rect.x;
-    if (rect.y + rect.height > binary.rows)
-        rect.height = binary.rows - rect.y;
-
-    cv::Mat binROI = binary(rect);
-
-    cv::Mat mask = cv::Mat::zeros(rect.height, rect.width, CV_8U);
-    std::vector<cv::Point> roiContour;
-    for (size_t i = 0; i < contour.size(); i++)
-    {
-        cv::Point pt = cv::Point(contour[i].x - rect.x, contour[i].y - rect.y);
-        roiContour.push_back(pt);
-    }
-
-    std::vector<std::vector<cv::Point> > roiContours = {roiContour};
-    cv::fillPoly(mask, roiContours, cv::Scalar(255));
-
-    double score = cv::mean(binROI, mask).val[0];
-    return score / 255.f;
-}
-
-static cv::Mat get_rotate_crop_image(const cv::Mat& rgb, const Object& object)
+// dst is a 48 rows header of the crop width, the crop is warped into it
+static void get_rotate_crop_image(const cv::Mat& rgb, const cv::RotatedRect& rrect, int orientation, cv::Mat& dst)
 {
-    const int orientation = object.orientation;
-    const float rw = object.rrect.size.width;
-    const float rh = object.rrect.size.height;
+    const float rw = rrect.size.width;
+    const float rh = rrect.size.height;
 
     const int target_height = 48;
     const float target_width = rh * target_height / rw;
@@ -74,10 +64,8 @@ static cv::Mat get_rotate_crop_image(const cv::Mat& rgb, const Object& object)
     // warpperspective shall be used to rotate the image
     // but actually they are all rectangles, so warpaffine is almost enough  :P
 
-    cv::Mat dst;
-
     cv::Point2f corners[4];
-    object.rrect.points(corners);
+    rrect.points(corners);
 
     if (orientation == 0)
     {
@@ -88,13 +76,13 @@ static cv::Mat get_rotate_crop_image(const cv::Mat& rgb, const Object& object)
         //  3--------2
         //      rh
 
-        std::vector<cv::Point2f> src_pts(4);
+        cv::Point2f src_pts[4];
         src_pts[0] = corners[0];
         src_pts[1] = corners[1];
         src_pts[2] = corners[2];
         src_pts[3] = corners[3];
 
-        std::vector<cv::Point2f> dst_pts(4);
+        cv::Point2f dst_pts[4];
         dst_pts[0] = cv::Point2f(0, 0);
         dst_pts[1] = cv::Point2f(target_width, 0);
         dst_pts[2] = cv::Point2f(target_width, target_height);
@@ -116,13 +104,13 @@ static cv::Mat get_rotate_crop_image(const cv::Mat& rgb, const Object& object)
         //  0----3
         //    rw
 
-        std::vector<cv::Point2f> src_pts(4);
+        cv::Point2f src_pts[4];
         src_pts[0] = corners[0];
         src_pts[1] = corners[1];
         src_pts[2] = corners[2];
         src_pts[3] = corners[3];
 
-        std::vector<cv::Point2f> dst_pts(4);
+        cv::Point2f dst_pts[4];
         dst_pts[0] = cv::Point2f(0, 0);
         dst_pts[1] = cv::Point2f(target_width, 0);
         dst_pts[2] = cv::Point2f(target_width, target_height);
@@ -131,363 +119,2648 @@ static cv::Mat get_rotate_crop_image(const cv::Mat& rgb, const Object& object)
         cv::Mat tm = cv::getPerspectiveTransform(src_pts, dst_pts);
         cv::warpPerspective(rgb, dst, tm, cv::Size(target_width, target_height), cv::INTER_LANCZOS4, cv::BORDER_REPLICATE);
     }
-
-    return dst;
 }
 
-PPOCRv5::PPOCRv5()
+static int make_text_box(cv::RotatedRect& rrect, float enlarge_ratio)
 {
-    target_size = 640;
-}
+    int orientation = 0;
+    if (rrect.angle >= -30 && rrect.angle <= 30 && rrect.size.height > rrect.size.width * 2.7)
+    {
+        // vertical text
+        orientation = 1;
+    }
+    if ((rrect.angle <= -60 || rrect.angle >= 60) && rrect.size.width > rrect.size.height * 2.7)
+    {
+        // vertical text
+        orientation = 1;
+    }
 
-PPOCRv5::~PPOCRv5()
-{
+    if (rrect.angle < -30)
+    {
+        // make orientation from -90 ~ -30 to 90 ~ 150
+        rrect.angle += 180;
+    }
+    if (orientation == 0 && rrect.angle < 30)
+    {
+        // make it horizontal
+        rrect.angle += 90;
+        std::swap(rrect.size.width, rrect.size.height);
+    }
+    if (orientation == 1 && rrect.angle >= 60)
+    {
+        // make it vertical
+        rrect.angle -= 90;
+        std::swap(rrect.size.width, rrect.size.height);
+    }
+
+    // enlarge
+    rrect.size.height += rrect.size.width * (enlarge_ratio - 1);
+    rrect.size.width *= enlarge_ratio;
+
+    return orientation;
 }
 
-void PPOCRv5::set_dictionary(const std::vector<std::string>& dict)
+struct TileBox
 {
-    dictionary = dict;
-}
+    Object obj;
+    int tile;
+    bool cut;
+};
 
-const std::string& PPOCRv5::get_char(int id) const
+static std::vector<int> tile_origins(int length, int tile_size, int tile_overlap)
 {
-    static const std::string empty_str = "";
-    if (id >= 0 && id < (int)dictionary.size()) {
-        return dictionary[id];
+    std::vector<int> origins;
+    if (length <= tile_size)
+    {
+        origins.push_back(0);
+        return origins;
     }
-    return empty_str;
+
+    const int step = tile_size - tile_overlap;
+    for (int x = 0; ; x += step)
+    {
+        if (x + tile_size >= length)
+        {
+            // last tile is flush with the far edge
+            origins.push_back(length - tile_size);
+            break;
+        }
+        origins.push_back(x);
+    }
+
+    return origins;
 }
 
-int PPOCRv5::load(const char* det_parampath, const char* det_modelpath, const char* rec_parampath, const char* rec_modelpath, bool use_fp16, bool use_gpu)
+// columns [x0, x1) of an object's rec input placed at dst_x in a forward job,
+// decoded into the object or into a chunk result slot
+struct RecSegment
 {
-    ppocrv5_det.clear();
-    ppocrv5_rec.clear();
+    int object;
+    int x0;
+    int x1;
+    int dst_x;
+    int result;
+};
+
+// text of one chunk with the line pixel position of every character
+struct ChunkResult
+{
+    std::vector<Character> text;
+    std::vector<int> x;
+    double start_time;
+    double end_time;
 
-    ppocrv5_det.opt.use_fp16_packed = use_fp16;
-    ppocrv5_det.opt.use_fp16_storage = use_fp16;
-    ppocrv5_det.opt.use_fp16_arithmetic = use_fp16;
+    ChunkResult() : start_time(0.0), end_time(0.0)
+    {
+    }
+};
 
-#if NCNN_VULKAN
-    ppocrv5_det.opt.use_vulkan_compute = use_gpu;
-#endif
+// append chunk b to text, the chunks overlap on line pixels [overlap_x0, overlap_x1)
+// characters in the overlap are aligned on their longest common subsequence and cut
+// at the middle matched pair, or at the overlap middle when nothing matches
+static void stitch_chunk(std::vector<Character>& text, std::vector<int>& text_x, const std::vector<Character>& b, const std::vector<int>& b_x, int overlap_x0, int overlap_x1)
+{
+    int a0 = (int)text.size();
+    while (a0 > 0 && text_x[a0 - 1] >= overlap_x0)
+        a0--;
 
-    ppocrv5_det.load_param(det_parampath);
-    ppocrv5_det.load_model(det_modelpath);
+    int b1 = 0;
+    while (b1 < (int)b.size() && b_x[b1] < overlap_x1)
+        b1++;
 
-    // default to 1 thread, as we rec multiple lines in parallel
-    ppocrv5_rec.opt.num_threads = 1;
+    const int na = (int)text.size() - a0;
+    const int nb = b1;
 
-    ppocrv5_rec.opt.use_fp16_packed = use_fp16;
-    ppocrv5_rec.opt.use_fp16_storage = use_fp16;
-    ppocrv5_rec.opt.use_fp16_arithmetic = use_fp16;
+    std::vector<int> lcs((na + 1) * (nb + 1), 0);
+    for (int i = na - 1; i >= 0; i--)
+    {
+        for (int j = nb - 1; j >= 0; j--)
+        {
+            if (text[a0 + i].id == b[j].id)
+                lcs[i * (nb + 1) + j] = lcs[(i + 1) * (nb + 1) + j + 1] + 1;
+            else
+                lcs[i * (nb + 1) + j] = std::max(lcs[(i + 1) * (nb + 1) + j], lcs[i * (nb + 1) + j + 1]);
+        }
+    }
 
-#if NCNN_VULKAN
-    ppocrv5_rec.opt.use_vulkan_compute = use_gpu;
-#endif
+    std::vector<std::pair<int, int> > matches;
+    for (int i = 0, j = 0; i < na && j < nb;)
+    {
+        if (text[a0 + i].id == b[j].id)
+        {
+            matches.push_back(std::make_pair(a0 + i, j));
+            i++;
+            j++;
+        }
+        else if (lcs[(i + 1) * (nb + 1) + j] >= lcs[i * (nb + 1) + j + 1])
+            i++;
+        else
+            j++;
+    }
 
-    ppocrv5_rec.load_param(rec_parampath);
-    ppocrv5_rec.load_model(rec_modelpath);
+    // keep text up to the cut and b after it
+    int keep_a;
+    int from_b;
+    if (!matches.empty())
+    {
+        const std::pair<int, int>& m = matches[matches.size() / 2];
+        keep_a = m.first + 1;
+        from_b = m.second + 1;
+    }
+    else
+    {
+        const int mid_x = (overlap_x0 + overlap_x1) / 2;
+        keep_a = a0;
+        while (keep_a < (int)text.size() && text_x[keep_a] < mid_x)
+            keep_a++;
+        from_b = 0;
+        while (from_b < (int)b.size() && b_x[from_b] < mid_x)
+            from_b++;
+    }
 
-    return 0;
+    text.resize(keep_a);
+    text_x.resize(keep_a);
+    text.insert(text.end(), b.begin() + from_b, b.end());
+    text_x.insert(text_x.end(), b_x.begin() + from_b, b_x.end());
 }
 
-int PPOCRv5::load(AAssetManager* mgr, const char* det_parampath, const char* det_modelpath, const char* rec_parampath, const char* rec_modelpath, bool use_fp16, bool use_gpu)
+static float intersection_area(const Object& a, const Object& b)
 {
-    ppocrv5_det.clear();
-    ppocrv5_rec.clear();
-
-    ppocrv5_det.opt.use_fp16_packed = use_fp16;
-    ppocrv5_det.opt.use_fp16_storage = use_fp16;
-    ppocrv5_det.opt.use_fp16_arithmetic = use_fp16;
-
-#if NCNN_VULKAN
-    ppocrv5_det.opt.use_vulkan_compute = use_gpu;
-#endif
-
-    ppocrv5_det.load_param(mgr, det_parampath);
-    ppocrv5_det.load_model(mgr, det_modelpath);
-
-    // default to 1 thread, as we rec multiple lines in parallel
-    ppocrv5_rec.opt.num_threads = 1;
+    if ((a.rrect.boundingRect2f() & b.rrect.boundingRect2f()).empty())
+        return 0.f;
 
-    ppocrv5_rec.opt.use_fp16_packed = use_fp16;
-    ppocrv5_rec.opt.use_fp16_storage = use_fp16;
-    ppocrv5_rec.opt.use_fp16_arithmetic = use_fp16;
-
-#if NCNN_VULKAN
-    ppocrv5_rec.opt.use_vulkan_compute = use_gpu;
-#endif
+    if (a.rrect.size.area() <= 0.f || b.rrect.size.area() <= 0.f)
+        return 0.f;
 
-    ppocrv5_rec.load_param(mgr, rec_parampath);
-    ppocrv5_rec.load_model(mgr, rec_modelpath);
+    std::vector<cv::Point2f> inter;
+    int ret = cv::rotatedRectangleIntersection(a.rrect, b.rrect, inter);
+    if (ret == cv::INTERSECT_NONE || inter.size() < 3)
+        return 0.f;
 
-    return 0;
+    return (float)cv::contourArea(inter);
 }
 
-void PPOCRv5::set_target_size(int _target_size)
+static int find_root(std::vector<int>& group, int i)
 {
-    target_size = _target_size;
+    while (group[i] != i)
+    {
+        group[i] = group[group[i]];
+        i = group[i];
+    }
+    return i;
 }
 
-int PPOCRv5::detect(const cv::Mat& rgb, std::vector<Object>& objects)
+static void merge_tile_boxes(const std::vector<TileBox>& boxes, std::vector<Object>& merged)
 {
-    cv::setNumThreads(ncnn::get_big_cpu_count());
-
-    int img_w = rgb.cols;
-    int img_h = rgb.rows;
+    // boxes fully seen by one tile, larger first
+    std::vector<const TileBox*> whole;
+    std::vector<const TileBox*> cut;
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        if (boxes[i].cut)
+            cut.push_back(&boxes[i]);
+        else
+            whole.push_back(&boxes[i]);
+    }
 
-    const int target_stride = 32;
+    std::sort(whole.begin(), whole.end(), [](const TileBox* a, const TileBox* b) {
+        return a->obj.rrect.size.area() > b->obj.rrect.size.area();
+    });
 
-    // letterbox pad to multiple of target_stride
-    int w = img_w;
-    int h = img_h;
-    float scale = 1.f;
-    if (std::max(w, h) > target_size)
+    // the same text seen whole by two overlapping tiles
+    std::vector<const TileBox*> kept;
+    for (size_t i = 0; i < whole.size(); i++)
     {
-        if (w > h)
+        const TileBox* tb = whole[i];
+        const float area = tb->obj.rrect.size.area();
+
+        bool duplicate = false;
+        for (size_t j = 0; j < kept.size(); j++)
         {
-            scale = (float)target_size / w;
-            w = target_size;
-            h = h * scale;
+            if (kept[j]->tile == tb->tile)
+                continue;
+
+            if (intersection_area(tb->obj, kept[j]->obj) > area * 0.5f)
+            {
+                duplicate = true;
+                break;
+            }
         }
-        else
+
+        if (!duplicate)
+            kept.push_back(tb);
+    }
+
+    // drop cut pieces already covered by a whole box from another tile
+    std::vector<const TileBox*> pieces;
+    for (size_t i = 0; i < cut.size(); i++)
+    {
+        const TileBox* tb = cut[i];
+        const float area = tb->obj.rrect.size.area();
+
+        bool covered = false;
+        for (size_t j = 0; j < kept.size(); j++)
         {
-            scale = (float)target_size / h;
-            h = target_size;
-            w = w * scale;
+            if (kept[j]->tile == tb->tile)
+                continue;
+
+            if (intersection_area(tb->obj, kept[j]->obj) > area * 0.5f)
+            {
+                covered = true;
+                break;
+            }
         }
+
+        if (!covered)
+            pieces.push_back(tb);
     }
 
-    ncnn::Mat in = ncnn::Mat::from_pixels_resize(rgb.data, ncnn::Mat::PIXEL_RGB2BGR, img_w, img_h, w, h);
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+        merged.push_back(kept[i]->obj);
+    }
 
-    int wpad = (w + target_stride - 1) / target_stride * target_stride - w;
-    int hpad = (h + target_stride - 1) / target_stride * target_stride - h;
-    ncnn::Mat in_pad;
-    ncnn::copy_make_border(in, in_pad, hpad / 2, hpad - hpad / 2, wpad / 2, wpad - wpad / 2, ncnn::BORDER_CONSTANT, 114.f);
+    // stitch the remaining pieces across seams
+    std::vector<int> group(pieces.size());
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        group[i] = i;
+    }
 
-    const float mean_vals[3] = {0.485f * 255.f, 0.456f * 255.f, 0.406f * 255.f};
-    const float norm_vals[3] = {1 / 0.229f / 255.f, 1 / 0.224f / 255.f, 1 / 0.225f / 255.f};
-    in_pad.substract_mean_normalize(mean_vals, norm_vals);
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        for (size_t j = i + 1; j < pieces.size(); j++)
+        {
+            if (pieces[i]->tile == pieces[j]->tile)
+                continue;
 
-    ncnn::Extractor ex = ppocrv5_det.create_extractor();
+            const float min_area = std::min(pieces[i]->obj.rrect.size.area(), pieces[j]->obj.rrect.size.area());
+            if (intersection_area(pieces[i]->obj, pieces[j]->obj) > min_area * 0.2f)
+            {
+                group[find_root(group, i)] = find_root(group, j);
+            }
+        }
+    }
 
-    ex.input("in0", in_pad);
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        if (find_root(group, i) != (int)i)
+            continue;
 
-    ncnn::Mat out;
-    ex.extract("out0", out);
+        std::vector<cv::Point2f> points;
+        float score = 0.f;
+        float area = 0.f;
+        for (size_t j = 0; j < pieces.size(); j++)
+        {
+            if (find_root(group, j) != (int)i)
+                continue;
 
-    const float denorm_vals[1] = {255.f};
-    out.substract_mean_normalize(0, denorm_vals);
+            cv::Point2f corners[4];
+            pieces[j]->obj.rrect.points(corners);
+            points.insert(points.end(), corners, corners + 4);
 
-    cv::Mat pred(out.h, out.w, CV_8UC1);
-    out.to_pixels(pred.data, ncnn::Mat::PIXEL_GRAY);
+            score += pieces[j]->obj.prob * pieces[j]->obj.rrect.size.area();
+            area += pieces[j]->obj.rrect.size.area();
+        }
 
-    // threshold binary
-    cv::Mat bitmap;
-    const float threshold = 0.3f;
-    cv::threshold(pred, bitmap, threshold * 255, 255, cv::THRESH_BINARY);
+        Object obj;
+        obj.rrect = cv::minAreaRect(points);
+        obj.orientation = 0;
+        obj.prob = area > 0.f ? score / area : 0.f;
+        merged.push_back(obj);
+    }
+}
 
-    // boxes from bitmap
+// input blob of the final softmax producing out0, -1 when there is none
+static int find_logits_blob(const ncnn::Net& net)
+{
+    const std::vector<ncnn::Layer*>& layers = net.layers();
+    const std::vector<ncnn::Blob>& blobs = net.blobs();
+    for (size_t i = 0; i < layers.size(); i++)
     {
-        // should use dbnet post process, but I think unclip process is difficult to write
-        // so simply implement expansion. This may lose detection accuracy
-        // original implementation can be referenced
-        // https://github.com/MhLiao/DB/blob/master/structure/representers/seg_detector_representer.py
+        const ncnn::Layer* layer = layers[i];
+        if (layer->type == "Softmax" && layer->bottoms.size() == 1 && layer->tops.size() == 1 && blobs[layer->tops[0]].name == "out0")
+            return layer->bottoms[0];
+    }
 
-        const float box_thresh = 0.6f;
-        const float enlarge_ratio = 1.95f;
+    return -1;
+}
 
-        const float min_size = 3 * scale;
-        const int max_candidates = 1000;
+// the quantized model of path, PP_OCRv5_mobile_det.ncnn.bin -> PP_OCRv5_mobile_det_int8.ncnn.bin
+static std::string int8_model_path(const char* path)
+{
+    std::string int8_path = path;
 
-        std::vector<std::vector<cv::Point> > contours;
-        std::vector<cv::Vec4i> hierarchy;
+    size_t pos = int8_path.rfind(".ncnn.");
+    if (pos == std::string::npos)
+        pos = int8_path.rfind('.');
+    if (pos == std::string::npos)
+        pos = int8_path.size();
 
-        cv::findContours(bitmap, contours, hierarchy, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+    int8_path.insert(pos, "_int8");
+    return int8_path;
+}
 
-        contours.resize(std::min(contours.size(), (size_t)max_candidates));
+static bool model_exists(AAssetManager* mgr, const char* path)
+{
+    if (mgr)
+    {
+        AAsset* asset = AAssetManager_open(mgr, path, AASSET_MODE_UNKNOWN);
+        if (asset)
+            AAsset_close(asset);
+        return asset != 0;
+    }
 
-        for (size_t i = 0; i < contours.size(); i++)
-        {
-            const std::vector<cv::Point>& contour = contours[i];
-            if (contour.size() <= 2)
-                continue;
+    FILE* fp = fopen(path, "rb");
+    if (fp)
+        fclose(fp);
+    return fp != 0;
+}
 
-            double score = contour_score(pred, contour);
-            if (score < box_thresh)
-                continue;
+// memory reader that never lends out the buffer, weights are copied into the net
+// so the fused or unaligned bin can go away right after loading
+class CopyingMemoryReader : public ncnn::DataReaderFromMemory
+{
+public:
+    explicit CopyingMemoryReader(const unsigned char*& mem)
+        : ncnn::DataReaderFromMemory(mem)
+    {
+    }
 
-            cv::RotatedRect rrect = cv::minAreaRect(contour);
+    virtual size_t reference(size_t /*size*/, const void** /*buf*/) const
+    {
+        return 0;
+    }
+};
 
-            float rrect_maxwh = std::max(rrect.size.width, rrect.size.height);
-            if (rrect_maxwh < min_size)
-                continue;
+// layers and BinaryOps listed in a plain param
+static void count_param_layers(const std::string& param, int& layers, int& binaryops)
+{
+    layers = 0;
+    binaryops = 0;
 
-            int orientation = 0;
-            if (rrect.angle >= -30 && rrect.angle <= 30 && rrect.size.height > rrect.size.width * 2.7)
-            {
-                // vertical text
-                orientation = 1;
-            }
-            if ((rrect.angle <= -60 || rrect.angle >= 60) && rrect.size.width > rrect.size.height * 2.7)
-            {
-                // vertical text
-                orientation = 1;
-            }
+    // the magic and the layer and blob counts come first
+    int line = 0;
+    size_t pos = 0;
+    while (pos < param.size())
+    {
+        size_t end = param.find('\n', pos);
+        if (end == std::string::npos)
+            end = param.size();
 
-            if (rrect.angle < -30)
-            {
-                // make orientation from -90 ~ -30 to 90 ~ 150
-                rrect.angle += 180;
-            }
-            if (orientation == 0 && rrect.angle < 30)
-            {
-                // make it horizontal
-                rrect.angle += 90;
-                std::swap(rrect.size.width, rrect.size.height);
-            }
-            if (orientation == 1 && rrect.angle >= 60)
-            {
-                // make it vertical
-                rrect.angle -= 90;
-                std::swap(rrect.size.width, rrect.size.height);
-            }
+        if (line >= 2 && end > pos)
+        {
+            layers++;
+            binaryops += param.compare(pos, 9, "BinaryOp ") == 0 ? 1 : 0;
+        }
 
-            // enlarge
-            rrect.size.height += rrect.size.width * (enlarge_ratio - 1);
-            rrect.size.width *= enlarge_ratio;
+        line++;
+        pos = end + 1;
+    }
+}
 
-            // adjust offset to original unpadded
-            rrect.center.x = (rrect.center.x - (wpad / 2)) / scale;
-            rrect.center.y = (rrect.center.y - (hpad / 2)) / scale;
-            rrect.size.width = (rrect.size.width) / scale;
-            rrect.size.height = (rrect.size.height) / scale;
+// high water mark of the resident set in KB, 0 when unknown
+static int64_t peak_rss_kb()
+{
+    FILE* fp = fopen("/proc/self/status", "r");
+    if (!fp)
+        return 0;
 
-            Object obj;
-            obj.rrect = rrect;
-            obj.orientation = orientation;
-            obj.prob = score;
-            objects.push_back(obj);
-        }
+    int64_t kb = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "VmHWM: %lld kB", (long long*)&kb) == 1)
+            break;
     }
 
-    return 0;
+    fclose(fp);
+    return kb;
 }
 
-int PPOCRv5::recognize(const cv::Mat& rgb, Object& object)
+// load net from its plain param and bin with the scalar affine chains folded,
+// -1 with nothing loaded when the graph can not be fused
+static int load_fused(ncnn::Net& net, const std::string& param, const ModelMapping& model, GraphFusionReport& report)
 {
-    cv::setNumThreads(1);
+    std::string fused_param;
+    std::vector<unsigned char> fused_model;
+    if (fuse_scalar_affine(param, model.data(), model.size(), fused_param, fused_model, &report) != 0)
+    {
+        __android_log_print(ANDROID_LOG_WARN, "ncnn", "graph fusion skipped, unknown layer weights");
+        return -1;
+    }
 
-    float original_region_height = object.rrect.size.height;
-    
-    cv::RotatedRect padded_rrect = object.rrect;
-    float padding_factor = 0.1f;
-    padded_rrect.size.width += object.rrect.size.width * padding_factor;
-    padded_rrect.size.height += object.rrect.size.height * padding_factor;
-    
-    Object padded_object = object;
-    padded_object.rrect = padded_rrect;
-    
-    cv::Mat roi = get_rotate_crop_image(rgb, padded_object);
-    
-    if (original_region_height < 20.0f && roi.rows > 0) {
-        float scale_factor = 20.0f / original_region_height;
-        int new_height = (int)(roi.rows * scale_factor);
-        int new_width = (int)(roi.cols * scale_factor);
-        if (new_height <= 96 && new_width > 0) {
-            cv::Mat upscaled;
-            cv::resize(roi, upscaled, cv::Size(new_width, new_height), 0, 0, cv::INTER_LANCZOS4);
-            roi = upscaled;
-        }
+    const unsigned char* mem = fused_model.data();
+    CopyingMemoryReader reader(mem);
+    if (net.load_param_mem(fused_param.c_str()) != 0 || net.load_model(reader) != 0)
+    {
+        net.clear();
+        return -1;
     }
 
-    ncnn::Mat in = ncnn::Mat::from_pixels(roi.data, ncnn::Mat::PIXEL_RGB2BGR, roi.cols, roi.rows);
+    __android_log_print(ANDROID_LOG_INFO, "ncnn", "graph fusion %d -> %d layers, %d -> %d BinaryOp",
+                        report.layers_before, report.layers_after, report.binaryops_before, report.binaryops_after);
+    return 0;
+}
 
-    // ~/.paddlex/official_models/PP-OCRv5_mobile_rec/inference.yml
-    const float mean_vals[3] = {127.5, 127.5, 127.5};
-    const float norm_vals[3] = {1.0 / 127.5, 1.0 / 127.5, 1.0 / 127.5};
-    in.substract_mean_normalize(mean_vals, norm_vals);
+// layer counts of a net loaded as is
+static void unfused_report(const ncnn::Net& net, GraphFusionReport& report)
+{
+    report = GraphFusionReport();
 
-    ncnn::Extractor ex = ppocrv5_rec.create_extractor();
+    const std::vector<ncnn::Layer*>& layers = net.layers();
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        report.binaryops_before += layers[i]->type == "BinaryOp" ? 1 : 0;
+    }
 
-    ex.input("in0", in);
+    report.layers_before = (int)layers.size();
+    report.layers_after = report.layers_before;
+    report.binaryops_after = report.binaryops_before;
+}
 
-    ncnn::Mat out;
-    ex.extract("out0", out);
+static float median(std::vector<float>& values)
+{
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
 
-    std::vector<int> tokens;
-    std::vector<float> scores;
-    
-    for (int i = 0; i < out.h; i++)
+// area covered by the union of rects
+static int64_t union_area(const std::vector<cv::Rect>& rects)
+{
+    std::vector<int> xs;
+    std::vector<int> ys;
+    for (size_t i = 0; i < rects.size(); i++)
     {
-        const float* p = out.row(i);
+        xs.push_back(rects[i].x);
+        xs.push_back(rects[i].x + rects[i].width);
+        ys.push_back(rects[i].y);
+        ys.push_back(rects[i].y + rects[i].height);
+    }
 
-        int index = 0;
-        float max_score = -9999.f;
-        for (int j = 0; j < out.w; j++)
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    int64_t area = 0;
+    for (size_t i = 0; i + 1 < ys.size(); i++)
+    {
+        for (size_t j = 0; j + 1 < xs.size(); j++)
         {
-            float score = *p++;
-            if (score > max_score)
+            const cv::Point cell_center((xs[j] + xs[j + 1]) / 2, (ys[i] + ys[i + 1]) / 2);
+            for (size_t k = 0; k < rects.size(); k++)
             {
-                max_score = score;
-                index = j;
+                if (rects[k].contains(cell_center))
+                {
+                    area += (int64_t)(xs[j + 1] - xs[j]) * (ys[i + 1] - ys[i]);
+                    break;
+                }
             }
         }
-
-        tokens.push_back(index);
-        scores.push_back(max_score);
     }
-    
-    int last_token = -1;
-    int last_token_position = -1;
-    
-    for (size_t i = 0; i < tokens.size(); i++)
+
+    return area;
+}
+
+PPOCRv5::PPOCRv5()
+{
+    target_size = 640;
+    tile_size = 0;
+    tile_overlap = 128;
+    tile_max_side = 4096;
+    coarse_size = 0;
+    coarse_tile_size = 384;
+    coarse_box_thresh = 0.3f;
+    dedup_overlap = 0.8f;
+    pack_width = 0;
+    pack_line_width = 320;
+    pack_separator = 32;
+    fast_ctc_decode = true;
+    chunk_width = 0;
+    chunk_overlap = 64;
+    chunk_verify = false;
+    rec_crop_interpolation = REC_CROP_LANCZOS;
+    two_tier = false;
+    two_tier_min_prob = 0.9f;
+    two_tier_interpolation = REC_CROP_BILINEAR;
+    text_filter = false;
+    text_filter_min_contrast = 0.1f;
+    text_filter_min_edge_density = 0.02f;
+    text_filter_max_edge_density = 0.5f;
+    rec_model_generation = 0;
+    graph_fusion = false;
+    det_precision = NET_PRECISION_DEFAULT;
+    rec_precision = NET_PRECISION_DEFAULT;
+    background_rec_load = false;
+    warm_up = false;
+    det_state = NET_STATE_EMPTY;
+    rec_state = NET_STATE_EMPTY;
+    load_time = 0.0;
+    load_peak_rss = 0;
+    rec_ready_time = 0.0;
+    rec_parallel_mode = REC_PARALLEL_AUTO;
+    rec_intra_min_width = 192;
+    rec_pass_threads = 1;
+    rec_logits_blob = -1;
+    adaptive_size_mode = ADAPTIVE_SIZE_OFF;
+    adaptive_min_text_height = 16.f;
+    adaptive_probe_size = 320;
+    adaptive_max_size = 2048;
+    last_text_height_ratio = 0.f;
+    cv_threads_pinned = false;
+
+    // one arena per worker of the det tile loop and the rec loop
+    const int arena_count = std::max(ncnn::get_big_cpu_count(), 1);
+    for (int i = 0; i < arena_count; i++)
+    {
+        det_arenas.push_back(new ScratchArena);
+        rec_arenas.push_back(new ScratchArena);
+    }
+
+    // recognition workers outlive calls, one per rec arena
+    rec_pool.start(arena_count);
+
+    set_rec_width_buckets(std::vector<int>());
+
+    reset_stats();
+}
+
+PPOCRv5::~PPOCRv5()
+{
+    if (rec_loader.joinable())
+        rec_loader.join();
+
+    rec_pool.stop();
+
+    for (size_t i = 0; i < det_arenas.size(); i++)
+    {
+        delete det_arenas[i];
+        delete rec_arenas[i];
+    }
+}
+
+void PPOCRv5::set_dictionary(const std::vector<std::string>& dict)
+{
+    dictionary = dict;
+}
+
+const std::string& PPOCRv5::get_char(int id) const
+{
+    static const std::string empty_str = "";
+    if (id >= 0 && id < (int)dictionary.size()) {
+        return dictionary[id];
+    }
+    return empty_str;
+}
+
+int PPOCRv5::load(const char* det_parampath, const char* det_modelpath, const char* rec_parampath, const char* rec_modelpath, bool use_fp16, bool use_gpu)
+{
+    return load_models(0, det_parampath, det_modelpath, rec_parampath, rec_modelpath, use_fp16, use_gpu);
+}
+
+int PPOCRv5::load(AAssetManager* mgr, const char* det_parampath, const char* det_modelpath, const char* rec_parampath, const char* rec_modelpath, bool use_fp16, bool use_gpu)
+{
+    return load_models(mgr, det_parampath, det_modelpath, rec_parampath, rec_modelpath, use_fp16, use_gpu);
+}
+
+int PPOCRv5::load_models(AAssetManager* mgr, const char* det_parampath, const char* det_modelpath, const char* rec_parampath, const char* rec_modelpath, bool use_fp16, bool use_gpu)
+{
+    // a background rec load of the previous models still owns the rec net
+    if (rec_loader.joinable())
+        rec_loader.join();
+
+    // blob sizes change with the models
+    for (size_t i = 0; i < det_arenas.size(); i++)
+    {
+        det_arenas[i]->clear();
+        rec_arenas[i]->clear();
+    }
+
+    rec_extractors.clear();
+    ppocrv5_det.clear();
+    ppocrv5_rec.clear();
+
+    // the old weights are no longer referenced
+    det_weights.close();
+    rec_weights.close();
+
+    const double start_time = ncnn::get_current_time();
+
+    // cached text belongs to the old rec model
+    rec_cache.clear();
+    rec_model_generation++;
+
+    det_state = NET_STATE_LOADING;
+    rec_state = NET_STATE_LOADING;
+    rec_ready_time = 0.0;
+
+#if NCNN_VULKAN
+    ppocrv5_det.opt.use_vulkan_compute = use_gpu;
+#endif
+
+    // default to 1 thread, as we rec multiple lines in parallel
+    ppocrv5_rec.opt.num_threads = 1;
+
+#if NCNN_VULKAN
+    ppocrv5_rec.opt.use_vulkan_compute = use_gpu;
+#endif
+
+    // rec loads on its own thread while det loads here, it only reads its own copies
+    // of the settings, setters that touch rec state wait for it in wait_rec()
+    const std::string rec_param = rec_parampath;
+    const std::string rec_bin = rec_modelpath;
+    const std::vector<int> buckets = rec_width_buckets;
+    rec_loader = std::thread([this, mgr, rec_param, rec_bin, buckets, use_fp16, start_time]() {
+        const int ret = load_net(ppocrv5_rec, mgr, rec_param.c_str(), rec_bin.c_str(), rec_precision, use_fp16, rec_weights, rec_model);
+        if (ret == 0)
+        {
+            // the softmax is not run when decoding from the logits
+            rec_logits_blob = find_logits_blob(ppocrv5_rec);
+
+            init_rec_options();
+
+            if (warm_up)
+            {
+                rec_state = NET_STATE_WARMING;
+                warm_up_rec(buckets);
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(rec_state_lock);
+        rec_ready_time = ncnn::get_current_time() - start_time;
+        rec_state = ret == 0 ? NET_STATE_READY : NET_STATE_FAILED;
+        rec_state_changed.notify_all();
+    });
+
+    const int det_ret = load_net(ppocrv5_det, mgr, det_parampath, det_modelpath, det_precision, use_fp16, det_weights, det_model);
+    if (det_ret == 0 && warm_up)
+    {
+        det_state = NET_STATE_WARMING;
+        warm_up_det();
+    }
+    det_state = det_ret == 0 ? NET_STATE_READY : NET_STATE_FAILED;
+
+    // detection can start right away, recognize() waits for the rec net
+    // a failed det load returns a finished engine, not one with rec still loading
+    int rec_ret = 0;
+    if (!background_rec_load || det_ret != 0)
+    {
+        rec_loader.join();
+        rec_ret = rec_state == NET_STATE_READY ? 0 : -1;
+    }
+
+    load_time = ncnn::get_current_time() - start_time;
+    load_peak_rss = peak_rss_kb();
+
+    return det_ret != 0 || rec_ret != 0 ? -1 : 0;
+}
+
+void PPOCRv5::warm_up_det()
+{
+    // a 4:3 canvas of target_size, what photos and screenshots mostly turn into
+    ncnn::Mat in(target_size, (target_size * 3 / 4 + 31) / 32 * 32, 3);
+    in.fill(0.f);
+
+    ncnn::Extractor ex = det_arenas[0]->extractor(ppocrv5_det);
+    ex.input("in0", in);
+
+    ncnn::Mat out;
+    ex.extract("out0", out);
+}
+
+void PPOCRv5::warm_up_rec(const std::vector<int>& buckets)
+{
+    // every worker primes its own arena at each bucket width, 320 without buckets
+    // buckets are for 48 px crops already, so they are the widths
+    std::vector<int> widths = buckets;
+    if (widths.empty())
+        widths.push_back(320);
+
+    const int count = rec_pool.num_threads();
+    rec_pool.run(count, std::vector<float>(count, 1.f), [&](int /*i*/) {
+        ScratchArena& arena = rec_arena();
+        for (size_t j = 0; j < widths.size(); j++)
+        {
+            ncnn::Mat in(widths[j], 48, 3);
+            in.fill(0.f);
+
+            ncnn::Extractor ex = arena.extractor(rec_extractors[0]);
+            ex.input("in0", in);
+
+            ncnn::Mat out;
+            if (rec_logits_blob >= 0)
+                ex.extract(rec_logits_blob, out);
+            else
+                ex.extract("out0", out);
+        }
+    });
+}
+
+bool PPOCRv5::wait_rec() const
+{
+    std::unique_lock<std::mutex> guard(rec_state_lock);
+    rec_state_changed.wait(guard, [this]() { return rec_state != NET_STATE_LOADING && rec_state != NET_STATE_WARMING; });
+    return rec_state == NET_STATE_READY;
+}
+
+int PPOCRv5::net_state(int net) const
+{
+    return net == 0 ? det_state.load() : rec_state.load();
+}
+
+int PPOCRv5::load_net(ncnn::Net& net, AAssetManager* mgr, const char* parampath, const char* modelpath, int precision, bool use_fp16, ModelMapping& weights, LoadedModel& loaded)
+{
+    loaded = LoadedModel();
+
+    if (precision == NET_PRECISION_DEFAULT)
+        precision = use_fp16 ? NET_PRECISION_FP16 : NET_PRECISION_FP32;
+
+    // the quantized model sits next to the float one, without it the float model runs in fp16
+    std::string param = parampath;
+    std::string model = modelpath;
+    if (precision == NET_PRECISION_INT8)
+    {
+        const std::string int8_param = int8_model_path(parampath);
+        const std::string int8_model = int8_model_path(modelpath);
+        if (model_exists(mgr, int8_param.c_str()) && model_exists(mgr, int8_model.c_str()))
+        {
+            param = int8_param;
+            model = int8_model;
+        }
+        else
+        {
+            __android_log_print(ANDROID_LOG_WARN, "ncnn", "%s not found, falling back to fp16", int8_param.c_str());
+            precision = NET_PRECISION_FP16;
+        }
+    }
+
+    // layers left in float by the quantizer still run in fp16 unless fp32 is asked for
+    const bool fp16 = precision != NET_PRECISION_FP32;
+    net.opt.use_fp16_packed = fp16;
+    net.opt.use_fp16_storage = fp16;
+    net.opt.use_fp16_arithmetic = fp16;
+    net.opt.use_int8_inference = precision == NET_PRECISION_INT8;
+
+    // both files are mapped, the bin is referenced in place unless it gets fused
+    ModelMapping param_mapping;
+    const int param_ret = mgr ? param_mapping.open_asset(mgr, param.c_str()) : param_mapping.open_file(param.c_str());
+    const int model_ret = mgr ? weights.open_asset(mgr, model.c_str()) : weights.open_file(model.c_str());
+    if (param_ret != 0 || model_ret != 0)
+    {
+        __android_log_print(ANDROID_LOG_ERROR, "ncnn", "failed to open %s", param_ret != 0 ? param.c_str() : model.c_str());
+        weights.close();
+        return -1;
+    }
+
+    // the param parser wants a terminated string
+    const std::string param_text((const char*)param_mapping.data(), param_mapping.size());
+    param_mapping.close();
+
+    loaded.precision = precision;
+    loaded.model_bytes = (int64_t)weights.size();
+    loaded.mapped = weights.mapped();
+
+    // folding scales into quantized weights would need a new calibration
+    if (graph_fusion && precision != NET_PRECISION_INT8)
+    {
+        if (model_cache.enabled() && load_cached(net, model, param_text, weights, loaded) == 0)
+            return 0;
+
+        if (load_fused(net, param_text, weights, loaded.fusion) == 0)
+        {
+            // the fused weights were copied into the net
+            weights.close();
+            return 0;
+        }
+    }
+
+    if (net.load_param_mem(param_text.c_str()) != 0)
+    {
+        __android_log_print(ANDROID_LOG_ERROR, "ncnn", "failed to load %s", param.c_str());
+        weights.close();
+        return -1;
+    }
+
+    // ncnn needs 32 bit aligned weights to reference them, stored assets normally are
+    const unsigned char* mem = weights.data();
+    int ret;
+    if (weights.aligned())
+    {
+        ncnn::DataReaderFromMemory reader(mem);
+        ret = net.load_model(reader);
+    }
+    else
+    {
+        CopyingMemoryReader reader(mem);
+        ret = net.load_model(reader);
+        weights.close();
+    }
+
+    if (ret != 0)
+    {
+        __android_log_print(ANDROID_LOG_ERROR, "ncnn", "failed to load %s", model.c_str());
+        net.clear();
+        weights.close();
+        return -1;
+    }
+
+    unfused_report(net, loaded.fusion);
+
+    return 0;
+}
+
+int PPOCRv5::load_cached(ncnn::Net& net, const std::string& name, const std::string& param_text, ModelMapping& weights, LoadedModel& loaded)
+{
+    const uint64_t key = ModelCache::model_key(param_text, weights.data(), weights.size());
+
+    std::string fused_param;
+    ModelMapping fused_model;
+    if (model_cache.open(name, key, fused_param, fused_model) == 0)
+    {
+        loaded.cached = true;
+        count_param_layers(param_text, loaded.fusion.layers_before, loaded.fusion.binaryops_before);
+        count_param_layers(fused_param, loaded.fusion.layers_after, loaded.fusion.binaryops_after);
+    }
+    else
+    {
+        // first load of this model, fuse with every weight in fp32 so later loads reference them as they are
+        std::vector<unsigned char> fused_bin;
+        if (fuse_scalar_affine(param_text, weights.data(), weights.size(), fused_param, fused_bin, &loaded.fusion, true) != 0)
+            return -1;
+
+        if (model_cache.store(name, key, fused_param, fused_bin) != 0 || model_cache.open(name, key, fused_param, fused_model) != 0)
+        {
+            __android_log_print(ANDROID_LOG_WARN, "ncnn", "model cache not writable");
+            return -1;
+        }
+    }
+
+    const unsigned char* mem = fused_model.data();
+    ncnn::DataReaderFromMemory reader(mem);
+    if (net.load_param_mem(fused_param.c_str()) != 0 || net.load_model(reader) != 0)
+    {
+        net.clear();
+        return -1;
+    }
+
+    // the net references the cached weights now, the source bin is done
+    weights.swap(fused_model);
+    loaded.mapped = weights.mapped();
+    return 0;
+}
+
+void PPOCRv5::init_rec_options()
+{
+    // only the runtime fields differ, the layer pipelines were built with the load options
+    // lines run single threaded side by side, an omp thread left over must sleep at once
+    // instead of spinning on a core the next line needs
+    rec_lines_opt = ppocrv5_rec.opt;
+    rec_lines_opt.num_threads = 1;
+    rec_lines_opt.openmp_blocktime = 0;
+
+    // one line on all cores, keep the team spinning across the many small layers
+    rec_intra_opt = ppocrv5_rec.opt;
+    rec_intra_opt.num_threads = rec_pool.num_threads();
+    rec_intra_opt.openmp_blocktime = 20;
+
+    // ncnn extractors take the net options when created and have no setter for them,
+    // so a blank extractor per thread count is made once and copied for every forward
+    const ncnn::Option load_opt = ppocrv5_rec.opt;
+
+    rec_extractors.clear();
+    for (int threads = 1; threads <= rec_intra_opt.num_threads; threads++)
+    {
+        ppocrv5_rec.opt = threads > 1 ? rec_intra_opt : rec_lines_opt;
+        ppocrv5_rec.opt.num_threads = threads;
+        rec_extractors.push_back(ppocrv5_rec.create_extractor());
+    }
+
+    ppocrv5_rec.opt = load_opt;
+}
+
+int PPOCRv5::plan_rec_threads(const std::vector<float>& costs)
+{
+    const int cores = rec_pool.num_threads();
+    const int count = std::max((int)costs.size(), 1);
+
+    int lines = std::min(count, cores);
+    if (rec_parallel_mode == REC_PARALLEL_LINES)
+        lines = cores;
+    else if (rec_parallel_mode == REC_PARALLEL_INTRA)
+        lines = 1;
+
+    const int threads = rec_line_threads(costs, lines);
+
+    // no rec forward is running here, the workers pick it up in forward_rec
+    rec_pass_threads = threads;
+
+    stats.rec_parallel_lines = lines;
+    stats.rec_threads_per_line = threads;
+
+    return lines;
+}
+
+int PPOCRv5::rec_line_threads(const std::vector<float>& costs, int lines) const
+{
+    if (rec_parallel_mode == REC_PARALLEL_AUTO)
+    {
+        // narrow crops are done before extra threads inside the forward pay off
+        const float widest = costs.empty() ? 0.f : *std::max_element(costs.begin(), costs.end()) * 48;
+        if (widest < rec_intra_min_width)
+            return 1;
+    }
+
+    return std::max(rec_pool.num_threads() / std::max(lines, 1), 1);
+}
+
+void PPOCRv5::set_rec_parallelism(int mode, int intra_min_width)
+{
+    rec_parallel_mode = mode;
+    rec_intra_min_width = intra_min_width;
+}
+
+void PPOCRv5::set_target_size(int _target_size)
+{
+    target_size = _target_size;
+}
+
+void PPOCRv5::set_tile_mode(int _tile_size, int _tile_overlap, int _tile_max_side)
+{
+    const int target_stride = 32;
+
+    // keep tiles and overlap aligned to the det stride
+    tile_size = _tile_size <= 0 ? 0 : std::max(_tile_size / target_stride * target_stride, target_stride * 4);
+    tile_overlap = std::min(std::max(_tile_overlap / target_stride * target_stride, target_stride), tile_size / 2);
+    tile_max_side = std::max(_tile_max_side, tile_size);
+}
+
+void PPOCRv5::set_coarse_to_fine(int _coarse_size, int _coarse_tile_size)
+{
+    const int target_stride = 32;
+
+    coarse_size = _coarse_size <= 0 ? 0 : std::max(_coarse_size / target_stride * target_stride, target_stride * 4);
+    coarse_tile_size = std::max(_coarse_tile_size / target_stride * target_stride, tile_overlap * 2);
+}
+
+void PPOCRv5::set_detection_params(const DetectionParams& params)
+{
+    det_params = params;
+}
+
+const DetectionParams& PPOCRv5::get_detection_params() const
+{
+    return det_params;
+}
+
+void PPOCRv5::set_adaptive_target_size(int mode, float min_text_height, int max_size)
+{
+    const int target_stride = 32;
+
+    adaptive_size_mode = mode;
+    adaptive_min_text_height = min_text_height;
+    adaptive_max_size = std::max(max_size / target_stride * target_stride, adaptive_probe_size);
+    last_text_height_ratio = 0.f;
+}
+
+void PPOCRv5::set_rec_width_buckets(const std::vector<int>& widths)
+{
+    wait_rec();
+
+    const int width_stride = 8;
+
+    rec_width_buckets.clear();
+    for (size_t i = 0; i < widths.size(); i++)
+    {
+        if (widths[i] > 0)
+            rec_width_buckets.push_back((widths[i] + width_stride - 1) / width_stride * width_stride);
+    }
+    std::sort(rec_width_buckets.begin(), rec_width_buckets.end());
+    rec_width_buckets.erase(std::unique(rec_width_buckets.begin(), rec_width_buckets.end()), rec_width_buckets.end());
+
+    // last slot counts crops wider than every bucket
+    for (size_t i = 0; i < rec_arenas.size(); i++)
+    {
+        rec_arenas[i]->bucket_inputs.assign(rec_width_buckets.size(), ncnn::Mat());
+        rec_arenas[i]->bucket_hits.assign(rec_width_buckets.size() + 1, 0);
+        rec_arenas[i]->bucket_time.assign(rec_width_buckets.size() + 1, 0.0);
+    }
+}
+
+int PPOCRv5::bucket_width(int bucket, int height) const
+{
+    const int width_stride = 8;
+
+    // buckets are given for 48 px high crops, upscaled small text keeps its aspect
+    return (rec_width_buckets[bucket] * height / 48 + width_stride - 1) / width_stride * width_stride;
+}
+
+int PPOCRv5::find_width_bucket(int width, int height) const
+{
+    for (int i = 0; i < (int)rec_width_buckets.size(); i++)
+    {
+        if (width <= bucket_width(i, height))
+            return i;
+    }
+
+    return (int)rec_width_buckets.size();
+}
+
+void PPOCRv5::set_line_packing(int _pack_width, int _pack_line_width, int _pack_separator)
+{
+    const int time_step = 8;
+
+    pack_width = _pack_width <= 0 ? 0 : (_pack_width + time_step - 1) / time_step * time_step;
+    pack_line_width = std::min(_pack_line_width, pack_width);
+    pack_separator = std::max((_pack_separator + time_step - 1) / time_step * time_step, time_step);
+}
+
+void PPOCRv5::set_rec_chunking(int _chunk_width, int _chunk_overlap, bool verify)
+{
+    const int time_step = 8;
+
+    chunk_width = _chunk_width <= 0 ? 0 : (_chunk_width + time_step - 1) / time_step * time_step;
+    chunk_overlap = std::min((std::max(_chunk_overlap, time_step) + time_step - 1) / time_step * time_step, chunk_width / 2);
+    chunk_verify = verify;
+}
+
+void PPOCRv5::set_rec_crop_interpolation(int interpolation)
+{
+    rec_crop_interpolation = interpolation;
+}
+
+void PPOCRv5::set_graph_fusion(bool enabled)
+{
+    wait_rec();
+
+    graph_fusion = enabled;
+}
+
+void PPOCRv5::set_model_cache_dir(const std::string& dir)
+{
+    wait_rec();
+
+    model_cache.set_dir(dir);
+}
+
+void PPOCRv5::set_model_loading(bool background_rec, bool warm_up_forward)
+{
+    wait_rec();
+
+    background_rec_load = background_rec;
+    warm_up = warm_up_forward;
+}
+
+void PPOCRv5::set_precision(int det, int rec)
+{
+    wait_rec();
+
+    // unknown values load as the default
+    det_precision = det >= NET_PRECISION_DEFAULT && det <= NET_PRECISION_INT8 ? det : NET_PRECISION_DEFAULT;
+    rec_precision = rec >= NET_PRECISION_DEFAULT && rec <= NET_PRECISION_INT8 ? rec : NET_PRECISION_DEFAULT;
+}
+
+void PPOCRv5::set_rec_cache(size_t max_bytes, int grid_step)
+{
+    rec_cache.set_capacity(max_bytes, grid_step);
+}
+
+void PPOCRv5::set_text_filter(bool enabled, float min_contrast, float min_edge_density, float max_edge_density)
+{
+    text_filter = enabled;
+    text_filter_min_contrast = min_contrast;
+    text_filter_min_edge_density = min_edge_density;
+    text_filter_max_edge_density = max_edge_density;
+}
+
+void PPOCRv5::set_rec_two_tier(bool enabled, float min_prob, int cheap_interpolation)
+{
+    two_tier = enabled;
+    two_tier_min_prob = min_prob;
+    two_tier_interpolation = cheap_interpolation;
+}
+
+void PPOCRv5::set_fast_ctc_decode(bool enabled)
+{
+    fast_ctc_decode = enabled;
+}
+
+void PPOCRv5::set_dedup_overlap(float overlap)
+{
+    dedup_overlap = overlap;
+}
+
+OcrStats PPOCRv5::get_stats() const
+{
+    OcrStats s = stats;
+    for (size_t i = 0; i < det_arenas.size(); i++)
+    {
+        s.scratch_allocs += det_arenas[i]->allocations();
+        s.scratch_bytes += det_arenas[i]->reserved_bytes();
+        s.det_forwards += det_arenas[i]->forwards;
+        s.det_forward_time += det_arenas[i]->forward_time;
+    }
+
+    s.det_layers_before = det_model.fusion.layers_before;
+    s.det_layers_after = det_model.fusion.layers_after;
+    s.det_binaryops_before = det_model.fusion.binaryops_before;
+    s.det_binaryops_after = det_model.fusion.binaryops_after;
+    s.det_precision = det_model.precision;
+    s.det_model_bytes = det_model.model_bytes;
+    s.det_model_mapped = det_model.mapped;
+    s.det_model_cached = det_model.cached;
+
+    // the rec loader may still be filling these in and warming the rec arenas
+    std::unique_lock<std::mutex> guard(rec_state_lock);
+    if (rec_state != NET_STATE_LOADING && rec_state != NET_STATE_WARMING)
+    {
+        for (size_t i = 0; i < rec_arenas.size(); i++)
+        {
+            s.scratch_allocs += rec_arenas[i]->allocations();
+            s.scratch_bytes += rec_arenas[i]->reserved_bytes();
+            s.rec_decode_time += rec_arenas[i]->decode_time;
+            s.rec_decode_steps += rec_arenas[i]->decode_steps;
+            s.rec_crop_time += rec_arenas[i]->crop_time;
+            s.rec_forwards += rec_arenas[i]->forwards;
+            s.rec_forward_time += rec_arenas[i]->forward_time;
+        }
+
+        s.rec_bucket_widths = rec_width_buckets;
+        s.rec_bucket_hits.assign(rec_width_buckets.size() + 1, 0);
+        s.rec_bucket_time.assign(rec_width_buckets.size() + 1, 0.0);
+        for (size_t i = 0; i < rec_arenas.size(); i++)
+        {
+            for (size_t j = 0; j < rec_arenas[i]->bucket_hits.size(); j++)
+            {
+                s.rec_bucket_hits[j] += rec_arenas[i]->bucket_hits[j];
+                s.rec_bucket_time[j] += rec_arenas[i]->bucket_time[j];
+            }
+        }
+
+        s.rec_layers_before = rec_model.fusion.layers_before;
+        s.rec_layers_after = rec_model.fusion.layers_after;
+        s.rec_binaryops_before = rec_model.fusion.binaryops_before;
+        s.rec_binaryops_after = rec_model.fusion.binaryops_after;
+        s.rec_precision = rec_model.precision;
+        s.rec_model_bytes = rec_model.model_bytes;
+        s.rec_model_mapped = rec_model.mapped;
+        s.rec_model_cached = rec_model.cached;
+        s.rec_ready_time = rec_ready_time;
+    }
+    guard.unlock();
+
+    s.load_time = load_time;
+    s.load_peak_rss = load_peak_rss;
+    s.det_state = det_state;
+    s.rec_state = rec_state;
+
+    s.rec_cache_hits = rec_cache.hits();
+    s.rec_cache_misses = rec_cache.misses();
+    s.rec_cache_entries = rec_cache.entries();
+    s.rec_cache_bytes = (int64_t)rec_cache.bytes();
+
+    return s;
+}
+
+void PPOCRv5::reset_stats()
+{
+    // the rec arenas belong to the loader until it is done
+    wait_rec();
+
+    stats = OcrStats();
+    for (size_t i = 0; i < det_arenas.size(); i++)
+    {
+        det_arenas[i]->reset_counters();
+        rec_arenas[i]->reset_counters();
+
+        std::fill(rec_arenas[i]->bucket_hits.begin(), rec_arenas[i]->bucket_hits.end(), 0);
+        std::fill(rec_arenas[i]->bucket_time.begin(), rec_arenas[i]->bucket_time.end(), 0.0);
+        rec_arenas[i]->decode_time = 0.0;
+        rec_arenas[i]->decode_steps = 0;
+        rec_arenas[i]->crop_time = 0.0;
+        rec_arenas[i]->forwards = 0;
+        rec_arenas[i]->forward_time = 0.0;
+        det_arenas[i]->forwards = 0;
+        det_arenas[i]->forward_time = 0.0;
+    }
+
+    rec_cache.reset_counters();
+}
+
+ScratchArena& PPOCRv5::det_arena() const
+{
+    // the tile loop never runs more threads than there are arenas
+    return *det_arenas[std::min(ncnn::get_omp_thread_num(), (int)det_arenas.size() - 1)];
+}
+
+ScratchArena& PPOCRv5::rec_arena() const
+{
+    return *rec_arenas[std::min(TaskPool::worker_index(), (int)rec_arenas.size() - 1)];
+}
+
+int PPOCRv5::forward_det(const cv::Mat& rgb, int canvas_size, DetectionSession& session)
+{
+    int img_w = rgb.cols;
+    int img_h = rgb.rows;
+
+    const int target_stride = 32;
+
+    // letterbox pad to multiple of target_stride
+    int w = img_w;
+    int h = img_h;
+    float scale = 1.f;
+    if (std::max(w, h) > canvas_size)
+    {
+        if (w > h)
+        {
+            scale = (float)canvas_size / w;
+            w = canvas_size;
+            h = h * scale;
+        }
+        else
+        {
+            scale = (float)canvas_size / h;
+            h = canvas_size;
+            w = w * scale;
+        }
+    }
+
+    int wpad = (w + target_stride - 1) / target_stride * target_stride - w;
+    int hpad = (h + target_stride - 1) / target_stride * target_stride - h;
+
+    // resize, pad and normalize straight from the rgb / rgba pixels
+    const float mean_vals[3] = {0.485f * 255.f, 0.456f * 255.f, 0.406f * 255.f};
+    const float norm_vals[3] = {1 / 0.229f / 255.f, 1 / 0.224f / 255.f, 1 / 0.225f / 255.f};
+    ScratchArena& arena = det_arena();
+
+    ncnn::Mat in_pad;
+    letterbox_to_tensor(rgb, w, h, wpad / 2, hpad / 2, w + wpad, h + hpad, 114.f, mean_vals, norm_vals, in_pad, &arena.blob_allocator);
+
+    const double start_time = ncnn::get_current_time();
+
+    ncnn::Extractor ex = arena.extractor(ppocrv5_det);
+
+    ex.input("in0", in_pad);
+
+    ex.extract("out0", session.heatmap);
+
+    arena.forwards++;
+    arena.forward_time += ncnn::get_current_time() - start_time;
+
+    session.scale = scale;
+    session.wpad = wpad;
+    session.hpad = hpad;
+    session.img_w = img_w;
+    session.img_h = img_h;
+
+    return 0;
+}
+
+int PPOCRv5::session_boxes(const DetectionSession& session, const DetectionParams& params, std::vector<Object>& boxes) const
+{
+    if (session.heatmap.empty())
+        return -1;
+
+    const float scale = session.scale;
+    const int wpad = session.wpad;
+    const int hpad = session.hpad;
+
+    // should use dbnet post process, but I think unclip process is difficult to write
+    // so simply implement expansion. This may lose detection accuracy
+    // original implementation can be referenced
+    // https://github.com/MhLiao/DB/blob/master/structure/representers/seg_detector_representer.py
+
+    const float min_size = 3 * scale;
+
+    ScratchArena& arena = det_arena();
+
+    std::vector<DBBox>& db_boxes = arena.db_boxes;
+    db_boxes.clear();
+    arena.db_postprocess.process(session.heatmap, params.threshold, params.box_thresh, min_size, params.max_candidates, db_boxes);
+
+    for (size_t i = 0; i < db_boxes.size(); i++)
+    {
+        cv::RotatedRect rrect = db_boxes[i].rrect;
+        float score = db_boxes[i].score;
+
+        // adjust offset to original unpadded
+        rrect.center.x = (rrect.center.x - (wpad / 2)) / scale;
+        rrect.center.y = (rrect.center.y - (hpad / 2)) / scale;
+        rrect.size.width = (rrect.size.width) / scale;
+        rrect.size.height = (rrect.size.height) / scale;
+
+        Object obj;
+        obj.rrect = rrect;
+        obj.orientation = 0;
+        obj.prob = score;
+        boxes.push_back(obj);
+    }
+
+    return 0;
+}
+
+int PPOCRv5::detect_boxes(const cv::Mat& rgb, int canvas_size, const DetectionParams& params, std::vector<Object>& boxes)
+{
+    DetectionSession session;
+    forward_det(rgb, canvas_size, session);
+
+    return session_boxes(session, params, boxes);
+}
+
+int PPOCRv5::detect(const cv::Mat& rgb, std::vector<Object>& objects)
+{
+    const size_t first = objects.size();
+
+    int ret = detect_region(rgb, 0, objects);
+
+    // remember the text scale for the next image
+    ScratchArena& arena = det_arena();
+    std::vector<float>& heights = arena.box_heights;
+    arena.reserve(heights, objects.size() - first);
+    for (size_t i = first; i < objects.size(); i++)
+    {
+        heights.push_back(objects[i].rrect.size.width);
+    }
+    if (!heights.empty())
+        last_text_height_ratio = median(heights) / std::max(rgb.cols, rgb.rows);
+
+    return ret;
+}
+
+int PPOCRv5::detect(const cv::Mat& rgb, const std::vector<cv::Rect>& rois, std::vector<Object>& objects)
+{
+    // rois share the pixel scale of rgb, so the previous text height is taken
+    // against the whole image and the roi boxes do not replace it
+    const int scale_side = std::max(rgb.cols, rgb.rows);
+
+    for (size_t i = 0; i < rois.size(); i++)
+    {
+        const cv::Rect roi = rois[i] & cv::Rect(0, 0, rgb.cols, rgb.rows);
+        if (roi.empty())
+            continue;
+
+        // letterbox the strided roi view on its own
+        std::vector<Object> roi_objects;
+        detect_region(rgb(roi), scale_side, roi_objects);
+
+        for (size_t j = 0; j < roi_objects.size(); j++)
+        {
+            Object& obj = roi_objects[j];
+            obj.rrect.center.x += roi.x;
+            obj.rrect.center.y += roi.y;
+            objects.push_back(obj);
+        }
+    }
+
+    return 0;
+}
+
+int PPOCRv5::detect_region(const cv::Mat& rgb, int scale_side, std::vector<Object>& objects)
+{
+    if (coarse_size > 0 && std::max(rgb.cols, rgb.rows) > coarse_size * 2)
+        return detect_coarse_to_fine(rgb, objects);
+
+    if (tile_size > 0 && std::max(rgb.cols, rgb.rows) > target_size)
+        return detect_tiled(rgb, objects);
+
+    return detect_single(rgb, scale_side, objects);
+}
+
+int PPOCRv5::detect_single(const cv::Mat& rgb, int scale_side, std::vector<Object>& objects)
+{
+    set_cv_threads(ncnn::get_big_cpu_count());
+
+    std::vector<Object> boxes;
+    bool have_boxes = false;
+    const int canvas_size = choose_target_size(rgb, scale_side, boxes, have_boxes);
+
+    if (!have_boxes)
+        detect_boxes(rgb, canvas_size, det_params, boxes);
+
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        Object& obj = boxes[i];
+        obj.orientation = make_text_box(obj.rrect, det_params.enlarge_ratio);
+        objects.push_back(obj);
+    }
+
+    stats.det_area += (int64_t)rgb.cols * rgb.rows;
+    stats.det_tiles += 1;
+
+    return 0;
+}
+
+int PPOCRv5::choose_target_size(const cv::Mat& rgb, int scale_side, std::vector<Object>& probe_boxes, bool& have_boxes)
+{
+    have_boxes = false;
+
+    stats.det_text_height = 0.f;
+    stats.det_size_clamped = 0;
+
+    if (adaptive_size_mode == ADAPTIVE_SIZE_OFF)
+    {
+        stats.det_size = target_size;
+        stats.det_size_reason = OcrStats::DET_SIZE_FIXED;
+        return target_size;
+    }
+
+    const int target_stride = 32;
+    const int long_side = std::max(rgb.cols, rgb.rows);
+
+    float text_height = 0.f;
+    if (adaptive_size_mode == ADAPTIVE_SIZE_PREVIOUS && last_text_height_ratio > 0.f)
+    {
+        text_height = last_text_height_ratio * (scale_side > 0 ? scale_side : long_side);
+        stats.det_size_reason = OcrStats::DET_SIZE_FROM_PREVIOUS;
+    }
+    else
+    {
+        // cheap pass with the normal thresholds, reused when its canvas is enough
+        detect_boxes(rgb, adaptive_probe_size, det_params, probe_boxes);
+
+        ScratchArena& arena = det_arena();
+        std::vector<float>& heights = arena.box_heights;
+        arena.reserve(heights, probe_boxes.size());
+        for (size_t i = 0; i < probe_boxes.size(); i++)
+        {
+            cv::RotatedRect rrect = probe_boxes[i].rrect;
+            make_text_box(rrect, det_params.enlarge_ratio);
+            heights.push_back(rrect.size.width);
+        }
+
+        if (heights.empty())
+        {
+            probe_boxes.clear();
+            stats.det_size = target_size;
+            stats.det_size_reason = OcrStats::DET_SIZE_NO_TEXT;
+            return target_size;
+        }
+
+        text_height = median(heights);
+        stats.det_size_reason = OcrStats::DET_SIZE_FROM_PROBE;
+    }
+
+    // smallest canvas keeping the dominant text at adaptive_min_text_height pixels
+    const float scale = adaptive_min_text_height / std::max(text_height, 1.f);
+    int size = (int)ceilf(long_side * scale / target_stride) * target_stride;
+
+    const int min_size = adaptive_probe_size;
+    const int max_size = std::min(adaptive_max_size, (long_side + target_stride - 1) / target_stride * target_stride);
+    if (size < min_size)
+    {
+        size = min_size;
+        stats.det_size_clamped = -1;
+    }
+    if (size > max_size)
+    {
+        size = max_size;
+        stats.det_size_clamped = 1;
+    }
+
+    stats.det_size = size;
+    stats.det_text_height = text_height;
+
+    if (stats.det_size_reason == OcrStats::DET_SIZE_FROM_PROBE && size <= adaptive_probe_size)
+        have_boxes = true;
+    else
+        probe_boxes.clear();
+
+    return size;
+}
+
+int PPOCRv5::detect(const cv::Mat& rgb, DetectionSession& session, std::vector<Object>& objects)
+{
+    set_cv_threads(ncnn::get_big_cpu_count());
+
+    std::vector<Object> probe_boxes;
+    bool have_boxes = false;
+    forward_det(rgb, choose_target_size(rgb, 0, probe_boxes, have_boxes), session);
+
+    // the session outlives this call, keep its heatmap off the arena
+    session.heatmap = session.heatmap.clone();
+
+    stats.det_area += (int64_t)rgb.cols * rgb.rows;
+    stats.det_tiles += 1;
+
+    return detect(session, det_params, objects);
+}
+
+int PPOCRv5::detect(const DetectionSession& session, const DetectionParams& params, std::vector<Object>& objects) const
+{
+    std::vector<Object> boxes;
+    int ret = session_boxes(session, params, boxes);
+    if (ret != 0)
+        return ret;
+
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        Object& obj = boxes[i];
+        obj.orientation = make_text_box(obj.rrect, params.enlarge_ratio);
+        objects.push_back(obj);
+    }
+
+    return 0;
+}
+
+int PPOCRv5::detect_tiled(const cv::Mat& rgb, std::vector<Object>& objects)
+{
+    // work at native scale unless the image is huge
+    float scale = 1.f;
+    if (std::max(rgb.cols, rgb.rows) > tile_max_side)
+        scale = (float)tile_max_side / std::max(rgb.cols, rgb.rows);
+
+    return detect_tiles(rgb, scale, tile_size > 0 ? tile_size : target_size, 0, objects);
+}
+
+int PPOCRv5::detect_coarse_to_fine(const cv::Mat& rgb, std::vector<Object>& objects)
+{
+    set_cv_threads(ncnn::get_big_cpu_count());
+
+    const int img_w = rgb.cols;
+    const int img_h = rgb.rows;
+
+    // low resolution pass, only tells where text probably is
+    DetectionParams coarse_params = det_params;
+    coarse_params.box_thresh = std::min(coarse_box_thresh, det_params.box_thresh);
+
+    std::vector<Object> coarse_boxes;
+    detect_boxes(rgb, coarse_size, coarse_params, coarse_boxes);
+
+    const float coarse_scale = std::min((float)coarse_size / std::max(img_w, img_h), 1.f);
+
+    // one coarse heatmap pixel of slack around the unclipped box
+    const int margin = (int)ceilf(4 / coarse_scale);
+
+    std::vector<cv::Rect> regions;
+    for (size_t i = 0; i < coarse_boxes.size(); i++)
+    {
+        cv::RotatedRect rrect = coarse_boxes[i].rrect;
+        make_text_box(rrect, det_params.enlarge_ratio);
+
+        cv::Rect region = rrect.boundingRect();
+        region.x -= margin;
+        region.y -= margin;
+        region.width += margin * 2;
+        region.height += margin * 2;
+        region &= cv::Rect(0, 0, img_w, img_h);
+        if (!region.empty())
+            regions.push_back(region);
+    }
+
+    // full resolution is the tiled scale when tiling is on, the target_size canvas otherwise
+    float scale = 1.f;
+    if (tile_size > 0)
+    {
+        if (std::max(img_w, img_h) > tile_max_side)
+            scale = (float)tile_max_side / std::max(img_w, img_h);
+    }
+    else
+    {
+        if (std::max(img_w, img_h) > target_size)
+            scale = (float)target_size / std::max(img_w, img_h);
+    }
+
+    return detect_tiles(rgb, scale, coarse_tile_size, &regions, objects);
+}
+
+int PPOCRv5::detect_tiles(const cv::Mat& rgb, float scale, int _tile_size, const std::vector<cv::Rect>* regions, std::vector<Object>& objects)
+{
+    set_cv_threads(ncnn::get_big_cpu_count());
+
+    const int img_w = rgb.cols;
+    const int img_h = rgb.rows;
+
+    const std::vector<int> tile_xs = tile_origins((int)(img_w * scale), _tile_size, tile_overlap);
+    const std::vector<int> tile_ys = tile_origins((int)(img_h * scale), _tile_size, tile_overlap);
+
+    std::vector<cv::Rect> tiles;
+    int tiles_skipped = 0;
+    for (size_t i = 0; i < tile_ys.size(); i++)
+    {
+        for (size_t j = 0; j < tile_xs.size(); j++)
+        {
+            // tile rect in source pixels
+            int x0 = (int)(tile_xs[j] / scale);
+            int y0 = (int)(tile_ys[i] / scale);
+            int x1 = std::min((int)ceilf((tile_xs[j] + _tile_size) / scale), img_w);
+            int y1 = std::min((int)ceilf((tile_ys[i] + _tile_size) / scale), img_h);
+            cv::Rect tile(x0, y0, x1 - x0, y1 - y0);
+
+            if (regions)
+            {
+                bool has_text = false;
+                for (size_t k = 0; k < regions->size(); k++)
+                {
+                    if (((*regions)[k] & tile).area() > 0)
+                    {
+                        has_text = true;
+                        break;
+                    }
+                }
+
+                if (!has_text)
+                {
+                    tiles_skipped++;
+                    continue;
+                }
+            }
+
+            tiles.push_back(tile);
+        }
+    }
+
+    // each tile forward runs single threaded inside the parallel region,
+    // so at most big_cpu_count tiles are alive at the same time
+    std::vector<std::vector<TileBox> > tile_boxes(tiles.size());
+
+    const int tile_threads = std::max(std::min((int)tiles.size(), ncnn::get_big_cpu_count()), 1);
+
+    #pragma omp parallel for num_threads(tile_threads) schedule(dynamic)
+    for (int i = 0; i < (int)tiles.size(); i++)
+    {
+        const cv::Rect& tile = tiles[i];
+
+        std::vector<Object> boxes;
+        detect_boxes(rgb(tile), (int)(std::max(tile.width, tile.height) * scale + 0.5f), det_params, boxes);
+
+        // boxes touching an inner tile edge may be cut by the seam
+        const float seam_margin = 4 / scale;
+
+        for (size_t j = 0; j < boxes.size(); j++)
+        {
+            TileBox tb;
+            tb.obj = boxes[j];
+            tb.obj.rrect.center.x += tile.x;
+            tb.obj.rrect.center.y += tile.y;
+            tb.tile = i;
+
+            const cv::Rect2f bbox = tb.obj.rrect.boundingRect2f();
+            tb.cut = (tile.x > 0 && bbox.x < tile.x + seam_margin)
+                     || (tile.y > 0 && bbox.y < tile.y + seam_margin)
+                     || (tile.x + tile.width < img_w && bbox.x + bbox.width > tile.x + tile.width - seam_margin)
+                     || (tile.y + tile.height < img_h && bbox.y + bbox.height > tile.y + tile.height - seam_margin);
+
+            tile_boxes[i].push_back(tb);
+        }
+    }
+
+    std::vector<TileBox> all_boxes;
+    for (size_t i = 0; i < tile_boxes.size(); i++)
+    {
+        all_boxes.insert(all_boxes.end(), tile_boxes[i].begin(), tile_boxes[i].end());
+    }
+
+    std::vector<Object> boxes;
+    merge_tile_boxes(all_boxes, boxes);
+
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        Object& obj = boxes[i];
+        obj.orientation = make_text_box(obj.rrect, det_params.enlarge_ratio);
+        objects.push_back(obj);
+    }
+
+    const int64_t area = (int64_t)img_w * img_h;
+    stats.det_area += area;
+    stats.det_skipped_area += area - union_area(tiles);
+    stats.det_tiles += (int)tiles.size();
+    stats.det_tiles_skipped += tiles_skipped;
+
+    return 0;
+}
+
+int PPOCRv5::rec_input(const cv::Mat& rgb, const Object& object, int interpolation, ncnn::Mat& in)
+{
+    ScratchArena& arena = rec_arena();
+
+    const double start_time = ncnn::get_current_time();
+
+    float original_region_height = object.rrect.size.height;
+    
+    cv::RotatedRect padded_rrect = object.rrect;
+    float padding_factor = 0.1f;
+    padded_rrect.size.width += object.rrect.size.width * padding_factor;
+    padded_rrect.size.height += object.rrect.size.height * padding_factor;
+    
+    const int crop_width = (int)(padded_rrect.size.height * 48 / padded_rrect.size.width);
+    if (crop_width <= 0)
+        return -1;
+
+    // ~/.paddlex/official_models/PP-OCRv5_mobile_rec/inference.yml
+    const float mean_vals[3] = {127.5, 127.5, 127.5};
+    const float norm_vals[3] = {1.0 / 127.5, 1.0 / 127.5, 1.0 / 127.5};
+
+    if (interpolation != REC_CROP_LANCZOS)
+    {
+        // one resampling pass from the image into the tensor, small text upscale included
+        int out_w = crop_width;
+        int out_h = 48;
+        if (original_region_height < 20.0f)
+        {
+            float scale_factor = 20.0f / original_region_height;
+            int new_height = (int)(out_h * scale_factor);
+            int new_width = (int)(out_w * scale_factor);
+            if (new_height <= 96 && new_width > 0)
+            {
+                out_w = new_width;
+                out_h = new_height;
+            }
+        }
+
+        // output (0, 0), (out_w, 0) and (0, out_h) land on corners 0, 1 and 3
+        cv::Point2f corners[4];
+        padded_rrect.points(corners);
+        const float m[6] = {
+            (corners[1].x - corners[0].x) / out_w, (corners[3].x - corners[0].x) / out_h, corners[0].x,
+            (corners[1].y - corners[0].y) / out_w, (corners[3].y - corners[0].y) / out_h, corners[0].y
+        };
+
+        crop_to_tensor(rgb, m, out_w, out_h, interpolation == REC_CROP_NEAREST ? CROP_NEAREST : CROP_BILINEAR, mean_vals, norm_vals, in, &arena.blob_allocator);
+
+        arena.crop_time += ncnn::get_current_time() - start_time;
+        return 0;
+    }
+
+    cv::Mat roi = arena.mat(arena.crop_buffer, 48, crop_width, rgb.type());
+    get_rotate_crop_image(rgb, padded_rrect, object.orientation, roi);
+    
+    if (original_region_height < 20.0f && roi.rows > 0) {
+        float scale_factor = 20.0f / original_region_height;
+        int new_height = (int)(roi.rows * scale_factor);
+        int new_width = (int)(roi.cols * scale_factor);
+        if (new_height <= 96 && new_width > 0) {
+            cv::Mat upscaled = arena.mat(arena.upscale_buffer, new_height, new_width, roi.type());
+            cv::resize(roi, upscaled, upscaled.size(), 0, 0, cv::INTER_LANCZOS4);
+            roi = upscaled;
+        }
+    }
+
+    const int pixel_type = roi.channels() == 4 ? ncnn::Mat::PIXEL_RGBA2BGR : ncnn::Mat::PIXEL_RGB2BGR;
+    in = ncnn::Mat::from_pixels(roi.data, pixel_type, roi.cols, roi.rows, &arena.blob_allocator);
+
+    in.substract_mean_normalize(mean_vals, norm_vals);
+
+    arena.crop_time += ncnn::get_current_time() - start_time;
+    return 0;
+}
+
+int PPOCRv5::forward_rec(ncnn::Mat& in, ncnn::Mat& out)
+{
+    ScratchArena& arena = rec_arena();
+
+    // pad to the bucket width with zeros, which is mid gray after normalize
+    // and is what the paddle resize_norm_img pads with
+    const int bucket = find_width_bucket(in.w, in.h);
+    if (bucket < (int)rec_width_buckets.size())
+    {
+        // a fixed shape per bucket, the mat is kept in the arena and only refilled
+        ncnn::Mat& padded = arena.bucket_inputs[bucket];
+        padded.create(bucket_width(bucket, in.h), in.h, in.c, 4u, &arena.blob_allocator);
+        for (int q = 0; q < in.c; q++)
+        {
+            for (int y = 0; y < in.h; y++)
+            {
+                const float* src = in.channel(q).row(y);
+                float* dst = padded.channel(q).row(y);
+                memcpy(dst, src, in.w * sizeof(float));
+                memset(dst + in.w, 0, (padded.w - in.w) * sizeof(float));
+            }
+        }
+        in = padded;
+    }
+
+    const double start_time = ncnn::get_current_time();
+
+    ncnn::Extractor ex = arena.extractor(rec_extractors[std::min(rec_pass_threads, (int)rec_extractors.size()) - 1]);
+
+    ex.input("in0", in);
+
+    if (fast_ctc_decode && rec_logits_blob >= 0)
+        ex.extract(rec_logits_blob, out);
+    else
+        ex.extract("out0", out);
+
+    arena.forwards++;
+    arena.forward_time += ncnn::get_current_time() - start_time;
+
+    return bucket;
+}
+
+void PPOCRv5::decode_ctc(const ncnn::Mat& out, int begin, int end, Object& object, std::vector<int>* steps)
+{
+    ScratchArena& arena = rec_arena();
+
+    const double start_time = ncnn::get_current_time();
+
+    if (fast_ctc_decode && rec_logits_blob >= 0)
+    {
+        std::vector<int>& ids = arena.tokens;
+        std::vector<float>& probs = arena.scores;
+        ids.clear();
+        probs.clear();
+
+        ctc_greedy_decode(out, begin, end, ids, probs, steps);
+
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            Character ch;
+            ch.id = ids[i];
+            ch.prob = probs[i];
+            object.text.push_back(ch);
+        }
+
+        arena.decode_time += ncnn::get_current_time() - start_time;
+        arena.decode_steps += end - begin;
+        return;
+    }
+
+    std::vector<int>& tokens = arena.tokens;
+    std::vector<float>& scores = arena.scores;
+    arena.reserve(tokens, end - begin);
+    arena.reserve(scores, end - begin);
+    
+    for (int i = begin; i < end; i++)
+    {
+        const float* p = out.row(i);
+
+        int index = 0;
+        float max_score = -9999.f;
+        for (int j = 0; j < out.w; j++)
+        {
+            float score = *p++;
+            if (score > max_score)
+            {
+                max_score = score;
+                index = j;
+            }
+        }
+
+        tokens.push_back(index);
+        scores.push_back(max_score);
+    }
+    
+    int last_token = -1;
+    int last_token_position = -1;
+    
+    for (size_t i = 0; i < tokens.size(); i++)
     {
         int index = tokens[i];
         float max_score = scores[i];
         
         if (index <= 0)
             continue;
-        
-        if (last_token == index && last_token_position >= 0) {
-            bool found_blank_between = false;
-            for (int j = i - 1; j > last_token_position; j--) {
-                if (tokens[j] == 0) {
-                    found_blank_between = true;
-                    break;
+        
+        if (last_token == index && last_token_position >= 0) {
+            bool found_blank_between = false;
+            for (int j = i - 1; j > last_token_position; j--) {
+                if (tokens[j] == 0) {
+                    found_blank_between = true;
+                    break;
+                }
+            }
+            
+            if (found_blank_between) {
+                Character ch;
+                ch.id = index - 1;
+                ch.prob = max_score;
+                object.text.push_back(ch);
+                if (steps)
+                    steps->push_back(begin + (int)i);
+                last_token = index;
+                last_token_position = i;
+            }
+        } else {
+            Character ch;
+            ch.id = index - 1;
+            ch.prob = max_score;
+            object.text.push_back(ch);
+            if (steps)
+                steps->push_back(begin + (int)i);
+            last_token = index;
+            last_token_position = i;
+        }
+    }
+
+    arena.decode_time += ncnn::get_current_time() - start_time;
+    arena.decode_steps += end - begin;
+}
+
+int PPOCRv5::recognize(const cv::Mat& rgb, Object& object)
+{
+    if (!wait_rec())
+        return -1;
+
+    if (two_tier)
+    {
+        // cheap then accurate pass as for a batch of one
+        std::vector<Object> objects(1, object);
+        const int ret = recognize(rgb, objects);
+        object = objects[0];
+        return ret;
+    }
+
+    recognize_line(rgb, object, rec_crop_interpolation);
+
+    if (text_filter)
+    {
+        stats.rec_filter_checked++;
+        stats.rec_filter_skipped += object.skipped ? 1 : 0;
+    }
+
+    return 0;
+}
+
+int PPOCRv5::recognize(const cv::Mat& rgb, std::vector<Object>& objects)
+{
+    if (!wait_rec())
+        return -1;
+
+    if (!two_tier)
+    {
+        recognize_lines(rgb, objects, rec_crop_interpolation);
+
+        count_text_filter(objects);
+
+        return 0;
+    }
+
+    double start_time = ncnn::get_current_time();
+
+    recognize_lines(rgb, objects, two_tier_interpolation);
+
+    count_text_filter(objects);
+
+    stats.rec_cheap_time += ncnn::get_current_time() - start_time;
+
+    // lines the cheap pass is unsure of, empty text included
+    std::vector<int> retry;
+    std::vector<Object> retry_objects;
+    int cheap_lines = 0;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        // non text stays skipped on the accurate path too
+        if (objects[i].skipped)
+            continue;
+
+        cheap_lines++;
+
+        const std::vector<Character>& text = objects[i].text;
+
+        float prob_sum = 0.f;
+        for (size_t j = 0; j < text.size(); j++)
+        {
+            prob_sum += text[j].prob;
+        }
+
+        if (!text.empty() && prob_sum >= two_tier_min_prob * text.size())
+            continue;
+
+        retry.push_back((int)i);
+        retry_objects.push_back(objects[i]);
+        retry_objects.back().text.clear();
+    }
+
+    // lines the text filter skipped were never recognized
+    stats.rec_cheap_lines += cheap_lines - (int)retry.size();
+    stats.rec_accurate_lines += (int)retry.size();
+
+    if (retry.empty())
+        return 0;
+
+    start_time = ncnn::get_current_time();
+
+    recognize_lines(rgb, retry_objects, rec_crop_interpolation);
+
+    count_text_filter(retry_objects);
+
+    stats.rec_accurate_time += ncnn::get_current_time() - start_time;
+
+    // the accurate crop may be rejected as non text where the cheap one was not
+    for (size_t i = 0; i < retry.size(); i++)
+    {
+        objects[retry[i]].text.swap(retry_objects[i].text);
+        objects[retry[i]].skipped = retry_objects[i].skipped;
+    }
+
+    return 0;
+}
+
+bool PPOCRv5::reject_non_text(const ncnn::Mat& in, Object& object) const
+{
+    object.skipped = false;
+
+    if (!text_filter)
+        return false;
+
+    // a luma step of a quarter of the black to white range counts as an edge
+    float contrast;
+    float edge_density;
+    crop_text_features(in, 0.5f, contrast, edge_density);
+
+    object.skipped = contrast < text_filter_min_contrast
+                     || edge_density < text_filter_min_edge_density
+                     || edge_density > text_filter_max_edge_density;
+
+    return object.skipped;
+}
+
+void PPOCRv5::count_text_filter(const std::vector<Object>& objects)
+{
+    if (!text_filter)
+        return;
+
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        stats.rec_filter_checked++;
+        stats.rec_filter_skipped += objects[i].skipped ? 1 : 0;
+    }
+}
+
+bool PPOCRv5::rec_cache_lookup(const ncnn::Mat& in, int interpolation, RecCacheKey& key, Object& object)
+{
+    if (!rec_cache.enabled())
+        return false;
+
+    ScratchArena& arena = rec_arena();
+
+    rec_cache.signature(in, (rec_model_generation << 8) | (uint64_t)interpolation, key);
+
+    if (!rec_cache.lookup(key, arena.tokens, arena.scores))
+        return false;
+
+    for (size_t i = 0; i < arena.tokens.size(); i++)
+    {
+        Character ch;
+        ch.id = arena.tokens[i];
+        ch.prob = arena.scores[i];
+        object.text.push_back(ch);
+    }
+
+    return true;
+}
+
+void PPOCRv5::rec_cache_store(const RecCacheKey& key, const Object& object)
+{
+    // no signature, the cache was off at lookup
+    if (key.w == 0)
+        return;
+
+    ScratchArena& arena = rec_arena();
+    arena.tokens.clear();
+    arena.scores.clear();
+    for (size_t i = 0; i < object.text.size(); i++)
+    {
+        arena.tokens.push_back(object.text[i].id);
+        arena.scores.push_back(object.text[i].prob);
+    }
+
+    rec_cache.insert(key, arena.tokens, arena.scores);
+}
+
+int PPOCRv5::recognize_line(const cv::Mat& rgb, Object& object, int interpolation)
+{
+    set_cv_threads(1);
+
+    const double start_time = ncnn::get_current_time();
+
+    ncnn::Mat in;
+    if (rec_input(rgb, object, interpolation, in) != 0)
+        return 0;
+
+    if (reject_non_text(in, object))
+        return 0;
+
+    RecCacheKey key;
+    if (rec_cache_lookup(in, interpolation, key, object))
+        return 0;
+
+    const int true_width = in.w;
+
+    ncnn::Mat out;
+    const int bucket = forward_rec(in, out);
+
+    // time steps past the true width only see padding
+    decode_ctc(out, 0, std::min(out.h, (true_width * out.h + in.w - 1) / in.w), object);
+
+    rec_cache_store(key, object);
+
+    ScratchArena& arena = rec_arena();
+    arena.bucket_hits[bucket]++;
+    arena.bucket_time[bucket] += ncnn::get_current_time() - start_time;
+
+    return 0;
+}
+
+int PPOCRv5::recognize_lines(const cv::Mat& rgb, std::vector<Object>& objects, int interpolation)
+{
+    const int count = (int)objects.size();
+
+    // the calling thread arena keeps the per line state
+    ScratchArena& line_arena = rec_arena();
+
+    // longest crops first, so a long line picked up last does not leave the other workers idle
+    // crop width over 48 is text length over height
+    std::vector<float>& costs = line_arena.line_costs;
+    line_arena.reserve(costs, count);
+    costs.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        costs[i] = objects[i].rrect.size.height / std::max(objects[i].rrect.size.width, 1.f);
+    }
+
+    if (pack_width <= 0 && chunk_width <= 0)
+    {
+        rec_pool.run(count, costs, [&](int i) {
+            recognize_line(rgb, objects[i], interpolation);
+        }, plan_rec_threads(costs));
+
+        return 0;
+    }
+
+    // lines neither packed nor chunked are the ones run in the crop pass
+    std::vector<float> single_costs;
+    for (int i = 0; i < count; i++)
+    {
+        const float width = costs[i] * 48;
+        if (!(pack_width > 0 && width <= pack_line_width) && !(chunk_width > 0 && width > chunk_width))
+            single_costs.push_back(costs[i]);
+    }
+
+    // crop everything, short 48 px lines are kept for packing and long lines for chunking,
+    // the rest are recognized one by one right away
+    // every line is cropped, filtered and looked up here, so the pass is sized from all of them,
+    // only the single lines are forwarded and their threads are planned from them alone
+    const int crop_lines = plan_rec_threads(costs);
+    if (!single_costs.empty())
+    {
+        rec_pass_threads = rec_line_threads(single_costs, crop_lines);
+        stats.rec_threads_per_line = rec_pass_threads;
+    }
+
+    std::vector<ncnn::Mat>& inputs = line_arena.line_inputs;
+    std::vector<RecCacheKey>& keys = line_arena.line_keys;
+    line_arena.reserve(inputs, count);
+    line_arena.reserve(keys, count);
+    inputs.resize(count);
+    keys.resize(count);
+
+    rec_pool.run(count, costs, [&](int i) {
+        set_cv_threads(1);
+
+        const double start_time = ncnn::get_current_time();
+
+        ncnn::Mat in;
+        if (rec_input(rgb, objects[i], interpolation, in) != 0)
+            return;
+
+        if (reject_non_text(in, objects[i]))
+            return;
+
+        if (rec_cache_lookup(in, interpolation, keys[i], objects[i]))
+            return;
+
+        if ((pack_width > 0 && in.h == 48 && in.w <= pack_line_width) || (chunk_width > 0 && in.w > chunk_width))
+        {
+            inputs[i] = in;
+            return;
+        }
+
+        const int true_width = in.w;
+
+        ncnn::Mat out;
+        const int bucket = forward_rec(in, out);
+
+        decode_ctc(out, 0, std::min(out.h, (true_width * out.h + in.w - 1) / in.w), objects[i]);
+
+        rec_cache_store(keys[i], objects[i]);
+
+        ScratchArena& arena = rec_arena();
+        arena.bucket_hits[bucket]++;
+        arena.bucket_time[bucket] += ncnn::get_current_time() - start_time;
+    }, crop_lines);
+
+    // forward jobs, each a run of segments copied side by side into one input
+    std::vector<RecSegment> segments;
+    std::vector<int> job_offsets;
+
+    const int time_step = 8;
+
+    // greedy packs in detection order, every line starts on a time step boundary
+    // and is followed by a blank separator
+    int packed_lines = 0;
+    int pack_count = 0;
+    int x = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (inputs[i].empty() || (chunk_width > 0 && inputs[i].w > chunk_width))
+            continue;
+
+        const int w = (inputs[i].w + time_step - 1) / time_step * time_step;
+        if (x > 0 && x + w > pack_width)
+            x = 0;
+
+        if (x == 0)
+        {
+            job_offsets.push_back((int)segments.size());
+            pack_count++;
+        }
+
+        RecSegment seg;
+        seg.object = i;
+        seg.x0 = 0;
+        seg.x1 = inputs[i].w;
+        seg.dst_x = x;
+        seg.result = -1;
+        segments.push_back(seg);
+
+        packed_lines++;
+        x += w + pack_separator;
+    }
+
+    // overlapping chunks of long lines, decoded into result slots and stitched afterwards
+    std::vector<int> chunked_objects;
+    std::vector<int> chunk_slot_offsets;
+    std::vector<int> verify_slots;
+    std::vector<ChunkResult> results;
+    for (int i = 0; i < count; i++)
+    {
+        if (inputs[i].empty() || chunk_width <= 0 || inputs[i].w <= chunk_width)
+            continue;
+
+        chunked_objects.push_back(i);
+        chunk_slot_offsets.push_back((int)results.size());
+
+        const std::vector<int> origins = tile_origins(inputs[i].w, chunk_width, chunk_overlap);
+        for (size_t k = 0; k < origins.size(); k++)
+        {
+            job_offsets.push_back((int)segments.size());
+
+            RecSegment seg;
+            seg.object = i;
+            seg.x0 = origins[k];
+            seg.x1 = origins[k] + chunk_width;
+            seg.dst_x = 0;
+            seg.result = (int)results.size();
+            segments.push_back(seg);
+
+            results.push_back(ChunkResult());
+        }
+    }
+    chunk_slot_offsets.push_back((int)results.size());
+
+    // the whole line once more, to measure chunking against it
+    for (size_t c = 0; chunk_verify && c < chunked_objects.size(); c++)
+    {
+        const int i = chunked_objects[c];
+
+        job_offsets.push_back((int)segments.size());
+
+        RecSegment seg;
+        seg.object = i;
+        seg.x0 = 0;
+        seg.x1 = inputs[i].w;
+        seg.dst_x = 0;
+        seg.result = (int)results.size();
+        segments.push_back(seg);
+
+        verify_slots.push_back((int)results.size());
+        results.push_back(ChunkResult());
+    }
+    job_offsets.push_back((int)segments.size());
+
+    const int job_count = (int)job_offsets.size() - 1;
+
+    std::vector<float> job_costs(job_count);
+    for (int j = 0; j < job_count; j++)
+    {
+        const RecSegment& last = segments[job_offsets[j + 1] - 1];
+        job_costs[j] = (float)(last.dst_x + last.x1 - last.x0);
+    }
+
+    rec_pool.run(job_count, job_costs, [&](int j) {
+        set_cv_threads(1);
+
+        const double start_time = ncnn::get_current_time();
+
+        ScratchArena& arena = rec_arena();
+
+        const int first = job_offsets[j];
+        const int last = job_offsets[j + 1];
+
+        const int job_w = segments[last - 1].dst_x + segments[last - 1].x1 - segments[last - 1].x0;
+        const int job_h = inputs[segments[first].object].h;
+
+        ncnn::Mat job;
+        job.create(job_w, job_h, 3, 4u, &arena.blob_allocator);
+        job.fill(0.f);
+
+        for (int k = first; k < last; k++)
+        {
+            const RecSegment& seg = segments[k];
+            const ncnn::Mat& in = inputs[seg.object];
+            for (int q = 0; q < in.c; q++)
+            {
+                for (int y = 0; y < in.h; y++)
+                {
+                    memcpy(job.channel(q).row(y) + seg.dst_x, in.channel(q).row(y) + seg.x0, (seg.x1 - seg.x0) * sizeof(float));
                 }
             }
-            
-            if (found_blank_between) {
-                Character ch;
-                ch.id = index - 1;
-                ch.prob = max_score;
-                object.text.push_back(ch);
-                last_token = index;
-                last_token_position = i;
+        }
+
+        ncnn::Mat out;
+        const int bucket = forward_rec(job, out);
+
+        // split the time steps back per segment
+        for (int k = first; k < last; k++)
+        {
+            const RecSegment& seg = segments[k];
+            const int x0 = seg.dst_x;
+            const int x1 = x0 + seg.x1 - seg.x0;
+            const int begin = x0 * out.h / job.w;
+            const int end = std::min(out.h, (x1 * out.h + job.w - 1) / job.w);
+
+            if (seg.result < 0)
+            {
+                decode_ctc(out, begin, end, objects[seg.object]);
+                continue;
             }
-        } else {
-            Character ch;
-            ch.id = index - 1;
-            ch.prob = max_score;
-            object.text.push_back(ch);
-            last_token = index;
-            last_token_position = i;
+
+            ChunkResult& result = results[seg.result];
+
+            Object decoded;
+            std::vector<int> steps;
+            decode_ctc(out, begin, end, decoded, &steps);
+
+            // character positions in pixels along the whole line
+            result.text = decoded.text;
+            for (size_t c = 0; c < steps.size(); c++)
+            {
+                result.x.push_back(seg.x0 + (int)((steps[c] + 0.5f) * job.w / out.h) - seg.dst_x);
+            }
+            result.start_time = start_time;
+            result.end_time = ncnn::get_current_time();
+        }
+
+        arena.bucket_hits[bucket]++;
+        arena.bucket_time[bucket] += ncnn::get_current_time() - start_time;
+    }, plan_rec_threads(job_costs));
+
+    for (size_t c = 0; c < chunked_objects.size(); c++)
+    {
+        const int i = chunked_objects[c];
+        const int first = chunk_slot_offsets[c];
+        const int last = chunk_slot_offsets[c + 1];
+
+        std::vector<Character> text = results[first].text;
+        std::vector<int> text_x = results[first].x;
+        double start_time = results[first].start_time;
+        double end_time = results[first].end_time;
+        for (int k = first + 1; k < last; k++)
+        {
+            const RecSegment& prev_seg = segments[job_offsets[pack_count + k - 1]];
+            const RecSegment& seg = segments[job_offsets[pack_count + k]];
+            stitch_chunk(text, text_x, results[k].text, results[k].x, seg.x0, prev_seg.x1);
+
+            start_time = std::min(start_time, results[k].start_time);
+            end_time = std::max(end_time, results[k].end_time);
+        }
+
+        objects[i].text.insert(objects[i].text.end(), text.begin(), text.end());
+
+        stats.rec_chunked_lines++;
+        stats.rec_chunks += last - first;
+        stats.rec_chunked_time += end_time - start_time;
+
+        if (chunk_verify)
+        {
+            const ChunkResult& whole = results[verify_slots[c]];
+
+            bool agreed = whole.text.size() == text.size();
+            for (size_t k = 0; agreed && k < text.size(); k++)
+            {
+                agreed = whole.text[k].id == text[k].id;
+            }
+
+            stats.rec_chunk_verified++;
+            stats.rec_chunk_agreed += agreed ? 1 : 0;
+            stats.rec_unchunked_time += whole.end_time - whole.start_time;
         }
     }
 
+    // packed and chunked lines are complete only now
+    for (int i = 0; i < count; i++)
+    {
+        if (!inputs[i].empty())
+            rec_cache_store(keys[i], objects[i]);
+    }
+
+    // give the crops back to the worker allocators
+    inputs.clear();
+
+    stats.rec_packs += pack_count;
+    stats.rec_packed_lines += packed_lines;
+
     return 0;
 }
 
+int PPOCRv5::dedup(std::vector<Object>& objects)
+{
+    const int count = (int)objects.size();
+    if (dedup_overlap <= 0.f || count < 2)
+        return 0;
+
+    // larger boxes first, so nested boxes meet their container
+    std::vector<int> order(count);
+    for (int i = 0; i < count; i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&objects](int a, int b) {
+        return objects[a].rrect.size.area() > objects[b].rrect.size.area();
+    });
+
+    std::vector<cv::Rect2f> bounds(count);
+    for (int i = 0; i < count; i++)
+    {
+        bounds[i] = objects[i].rrect.boundingRect2f();
+    }
+
+    BoxGrid grid;
+    grid.build(bounds);
+
+    std::vector<char> kept(count, 0);
+    std::vector<int> candidates;
+    int removed = 0;
+    for (int k = 0; k < count; k++)
+    {
+        const int i = order[k];
+        const float area = objects[i].rrect.size.area();
+
+        bool suppressed = false;
+        grid.query(bounds[i], candidates);
+        for (size_t j = 0; j < candidates.size(); j++)
+        {
+            const int c = candidates[j];
+            if (!kept[c])
+                continue;
+
+            const float min_area = std::min(area, objects[c].rrect.size.area());
+            if (intersection_area(objects[i], objects[c]) > min_area * dedup_overlap)
+            {
+                suppressed = true;
+                break;
+            }
+        }
+
+        if (suppressed)
+            removed++;
+        else
+            kept[i] = 1;
+    }
+
+    // keep detection order
+    int n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (kept[i])
+            objects[n++] = objects[i];
+    }
+    objects.resize(n);
+
+    stats.rec_dedup_skipped += removed;
+
+    return removed;
+}
+
 int PPOCRv5::detect_and_recognize(const cv::Mat& rgb, std::vector<Object>& objects)
 {
     detect(rgb, objects);
 
-    #pragma omp parallel for num_threads(ncnn::get_big_cpu_count()) schedule(dynamic)
-    for (size_t i = 0; i < objects.size(); i++)
+    dedup(objects);
+
+    return recognize(rgb, objects);
+}
+
+int PPOCRv5::detect_and_recognize(const cv::Mat& rgb, const std::vector<cv::Rect>& rois, std::vector<Object>& objects)
+{
+    detect(rgb, rois, objects);
+
+    // also drops duplicates from overlapping rois
+    dedup(objects);
+
+    // crops may read past the roi border, coordinates are full image already
+    return recognize(rgb, objects);
+}
+
+struct PipelineItem
+{
+    int index;
+    cv::Mat rgb;
+    std::vector<Object> objects;
+};
+
+int PPOCRv5::detect_and_recognize_pipelined(const std::function<bool(cv::Mat&)>& fetch, const std::function<void(int, std::vector<Object>&)>& done, int max_in_flight)
+{
+    max_in_flight = std::max(max_in_flight, 1);
+
+    // opencv has one process wide thread count, det and rec run side by side here
+    // and would keep overwriting it, so both stages get a single thread
+    cv::setNumThreads(1);
+    cv_threads_pinned = true;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<PipelineItem*> det_queue;
+    std::deque<PipelineItem*> rec_queue;
+    bool fetch_finished = false;
+
+    // detection worker, det and rec use separate arenas and stats fields
+    std::thread det_thread([&]() {
+        while (true)
+        {
+            PipelineItem* item = 0;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return !det_queue.empty() || fetch_finished; });
+                if (det_queue.empty())
+                    break;
+
+                item = det_queue.front();
+                det_queue.pop_front();
+            }
+
+            detect(item->rgb, item->objects);
+
+            dedup(item->objects);
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                rec_queue.push_back(item);
+            }
+            changed.notify_all();
+        }
+    });
+
+    int count = 0;
+    int in_flight = 0;
+    bool has_more = true;
+    while (true)
     {
-        recognize(rgb, objects[i]);
+        // top up the det queue, backpressure comes from max_in_flight
+        while (has_more && in_flight < max_in_flight)
+        {
+            PipelineItem* item = new PipelineItem;
+            if (!fetch(item->rgb))
+            {
+                delete item;
+                has_more = false;
+
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    fetch_finished = true;
+                }
+                changed.notify_all();
+                break;
+            }
+
+            item->index = count++;
+            in_flight++;
+
+            std::lock_guard<std::mutex> guard(lock);
+            det_queue.push_back(item);
+            changed.notify_all();
+        }
+
+        if (in_flight == 0)
+            break;
+
+        PipelineItem* item = 0;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return !rec_queue.empty(); });
+
+            item = rec_queue.front();
+            rec_queue.pop_front();
+        }
+
+        // the worker is already on the next image
+        recognize(item->rgb, item->objects);
+
+        done(item->index, item->objects);
+
+        delete item;
+        in_flight--;
     }
 
-    return 0;
+    det_thread.join();
+
+    cv_threads_pinned = false;
+
+    return count;
+}
+
+void PPOCRv5::set_cv_threads(int threads) const
+{
+    if (!cv_threads_pinned)
+        cv::setNumThreads(threads);
 }
@@ -19,6 +19,20 @@
 
 #include <net.h>
 
+#include "graph_fusion.h"
+#include "model_cache.h"
+#include "model_mapping.h"
+#include "rec_cache.h"
+#include "task_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class ScratchArena;
+
 struct Character
 {
     int id;
@@ -31,6 +45,189 @@ struct Object
     int orientation;
     float prob;
     std::vector<Character> text;
+    // rejected as non text before recognition, text stays empty
+    bool skipped;
+
+    Object() : orientation(0), prob(0.f), skipped(false)
+    {
+    }
+};
+
+// DB post processing parameters
+struct DetectionParams
+{
+    // heatmap binarization threshold
+    float threshold;
+    // minimum mean heatmap score of a text region
+    float box_thresh;
+    // box expansion in place of unclip
+    float enlarge_ratio;
+    int max_candidates;
+
+    DetectionParams()
+        : threshold(0.3f), box_thresh(0.6f), enlarge_ratio(1.95f), max_candidates(1000)
+    {
+    }
+};
+
+// raw det output and letterbox geometry of one image,
+// post processing can be re-run on it without another forward pass
+struct DetectionSession
+{
+    ncnn::Mat heatmap;
+    float scale;
+    int wpad;
+    int hpad;
+    int img_w;
+    int img_h;
+
+    DetectionSession()
+        : scale(1.f), wpad(0), hpad(0), img_w(0), img_h(0)
+    {
+    }
+};
+
+// counters accumulated since the last reset_stats()
+struct OcrStats
+{
+    // detection, areas in input image pixels
+    int64_t det_area;
+    int64_t det_skipped_area;
+    int det_tiles;
+    int det_tiles_skipped;
+
+    // det canvas chosen for the last single canvas image
+    enum
+    {
+        DET_SIZE_FIXED = 0,
+        DET_SIZE_FROM_PROBE = 1,
+        DET_SIZE_FROM_PREVIOUS = 2,
+        DET_SIZE_NO_TEXT = 3
+    };
+    int det_size;
+    int det_size_reason;
+    // -1 raised to the probe size, 1 lowered to max size or native resolution
+    int det_size_clamped;
+    // dominant text height in input pixels the choice was based on
+    float det_text_height;
+
+    // recognition calls saved by box dedup
+    int rec_dedup_skipped;
+
+    // growths of the scratch arenas: ncnn blobs, letterbox rows, db post process, crops
+    // and per line rec state, flat once warmed up, result and pack/chunk bookkeeping is not counted
+    int64_t scratch_allocs;
+    // bytes currently held by the scratch arenas
+    int64_t scratch_bytes;
+
+    // rec width buckets, hits and total rec time in ms per bucket
+    // with one extra slot for crops wider than every bucket
+    std::vector<int> rec_bucket_widths;
+    std::vector<int64_t> rec_bucket_hits;
+    std::vector<double> rec_bucket_time;
+
+    // packed rec forward passes and the lines they carried
+    int rec_packs;
+    int rec_packed_lines;
+
+    // ctc decoding time in ms and the time steps decoded
+    double rec_decode_time;
+    int64_t rec_decode_steps;
+
+    // rec crop and normalize time in ms
+    double rec_crop_time;
+
+    // rec core split of the last recognition pass
+    int rec_parallel_lines;
+    int rec_threads_per_line;
+
+    // long lines recognized in chunks, the chunks, and the time in ms
+    // from the first chunk starting to the last one finishing, summed over lines
+    int rec_chunked_lines;
+    int rec_chunks;
+    double rec_chunked_time;
+
+    // chunked lines also recognized whole, those whose text matched,
+    // and the whole line rec time in ms
+    int rec_chunk_verified;
+    int rec_chunk_agreed;
+    double rec_unchunked_time;
+
+    // two tier rec, lines finished by the cheap pass, lines re-run on the accurate path,
+    // and the time in ms of each pass
+    int rec_cheap_lines;
+    int rec_accurate_lines;
+    double rec_cheap_time;
+    double rec_accurate_time;
+
+    // rec cache lookups that skipped the forward pass and those that missed,
+    // cached lines and their estimated bytes
+    int64_t rec_cache_hits;
+    int64_t rec_cache_misses;
+    int rec_cache_entries;
+    int64_t rec_cache_bytes;
+
+    // crops checked by the non text filter and those it skipped
+    int rec_filter_checked;
+    int rec_filter_skipped;
+
+    // layers and BinaryOps of the loaded nets before and after graph fusion
+    int det_layers_before;
+    int det_layers_after;
+    int det_binaryops_before;
+    int det_binaryops_after;
+    int rec_layers_before;
+    int rec_layers_after;
+    int rec_binaryops_before;
+    int rec_binaryops_after;
+
+    // net forward passes and their time in ms
+    int64_t det_forwards;
+    double det_forward_time;
+    int64_t rec_forwards;
+    double rec_forward_time;
+
+    // NET_PRECISION_* the nets were loaded with and the size of their weights
+    int det_precision;
+    int rec_precision;
+    int64_t det_model_bytes;
+    int64_t rec_model_bytes;
+
+    // weights read straight from the page cache without a heap copy,
+    // time in ms of the last load and the process peak resident KB after it
+    bool det_model_mapped;
+    bool rec_model_mapped;
+
+    // fused weights taken from the model cache instead of fusing again
+    bool det_model_cached;
+    bool rec_model_cached;
+    double load_time;
+    int64_t load_peak_rss;
+
+    // PPOCRv5::NET_STATE_* of each net and the ms from the start of load until rec was ready
+    int det_state;
+    int rec_state;
+    double rec_ready_time;
+
+    OcrStats()
+        : det_area(0), det_skipped_area(0), det_tiles(0), det_tiles_skipped(0),
+          det_size(0), det_size_reason(DET_SIZE_FIXED), det_size_clamped(0), det_text_height(0.f),
+          rec_dedup_skipped(0), scratch_allocs(0), scratch_bytes(0),
+          rec_packs(0), rec_packed_lines(0), rec_decode_time(0.0), rec_decode_steps(0), rec_crop_time(0.0),
+          rec_parallel_lines(0), rec_threads_per_line(0),
+          rec_chunked_lines(0), rec_chunks(0), rec_chunked_time(0.0),
+          rec_chunk_verified(0), rec_chunk_agreed(0), rec_unchunked_time(0.0),
+          rec_cheap_lines(0), rec_accurate_lines(0), rec_cheap_time(0.0), rec_accurate_time(0.0),
+          rec_cache_hits(0), rec_cache_misses(0), rec_cache_entries(0), rec_cache_bytes(0),
+          rec_filter_checked(0), rec_filter_skipped(0),
+          det_layers_before(0), det_layers_after(0), det_binaryops_before(0), det_binaryops_after(0),
+          rec_layers_before(0), rec_layers_after(0), rec_binaryops_before(0), rec_binaryops_after(0),
+          det_forwards(0), det_forward_time(0.0), rec_forwards(0), rec_forward_time(0.0),
+          det_precision(0), rec_precision(0), det_model_bytes(0), rec_model_bytes(0),
+          det_model_mapped(false), rec_model_mapped(false), det_model_cached(false), rec_model_cached(false),
+          load_time(0.0), load_peak_rss(0), det_state(0), rec_state(0), rec_ready_time(0.0)
+    {
+    }
 };
 
 class PPOCRv5
@@ -43,19 +240,328 @@ public:
     int load(AAssetManager* mgr, const char* det_parampath, const char* det_modelpath, const char* rec_parampath, const char* rec_modelpath, bool use_fp16 = false, bool use_gpu = false);
 
     void set_target_size(int target_size);
+
+    // fold scalar BinaryOp chains into the neighbouring convs while loading, off by default,
+    // takes effect on the next load, fusion_check.py compares the fused outputs
+    void set_graph_fusion(bool enabled);
+
+    enum
+    {
+        // fp16 or fp32 as given to load
+        NET_PRECISION_DEFAULT = -1,
+        NET_PRECISION_FP32 = 0,
+        NET_PRECISION_FP16 = 1,
+        // the _int8 model next to the float one, made by calibrate_int8.sh
+        NET_PRECISION_INT8 = 2
+    };
+
+    // keep fused models in dir between launches, empty disables, takes effect on the next load
+    void set_model_cache_dir(const std::string& dir);
+
+    // load rec on a background thread, load returns once det is ready and recognize waits for rec,
+    // warm_up runs a forward at typical shapes after loading to prime the allocators
+    void set_model_loading(bool background_rec, bool warm_up);
+
+    enum
+    {
+        NET_STATE_FAILED = -1,
+        NET_STATE_EMPTY = 0,
+        NET_STATE_LOADING = 1,
+        NET_STATE_WARMING = 2,
+        NET_STATE_READY = 3
+    };
+
+    // NET_STATE_* of det for net 0, of rec otherwise
+    int net_state(int net) const;
+
+    // NET_PRECISION_* of each net, takes effect on the next load, other values mean default
+    void set_precision(int det_precision, int rec_precision);
+
+    enum
+    {
+        ADAPTIVE_SIZE_OFF = 0,
+        // estimate text height with a cheap low resolution pass
+        ADAPTIVE_SIZE_PROBE = 1,
+        // reuse the text height of the previous image, probe for the first one
+        ADAPTIVE_SIZE_PREVIOUS = 2
+    };
+
+    // pick the smallest det canvas keeping the dominant text above min_text_height pixels,
+    // target_size is used when off or when no text is found
+    void set_adaptive_target_size(int mode, float min_text_height = 16.f, int max_size = 2048);
+
+    // tiled detection for inputs larger than target_size
+    // tiles are cut at near-native scale, tile_size = 0 disables tiling
+    void set_tile_mode(int tile_size, int tile_overlap = 128, int tile_max_side = 4096);
+
+    // coarse to fine detection, a coarse_size canvas pass finds text areas
+    // and only tiles covering them are run at full resolution, coarse_size = 0 disables
+    void set_coarse_to_fine(int coarse_size, int coarse_tile_size = 384);
+
+    void set_detection_params(const DetectionParams& params);
+    const DetectionParams& get_detection_params() const;
+
+    // boxes covered by a larger box beyond this fraction of their area are dropped
+    // before recognition, 0 disables
+    void set_dedup_overlap(float overlap);
+
+    // pad rec crops to the smallest bucket width that fits so the rec net sees a few fixed shapes,
+    // widths are for 48 px high crops, an empty list feeds every crop at its own width
+    void set_rec_width_buckets(const std::vector<int>& widths);
+
+    // recognize 48 px lines up to pack_line_width wide side by side in one pack_width input,
+    // separated by pack_separator blank pixels, pack_width = 0 disables
+    void set_line_packing(int pack_width, int pack_line_width = 320, int pack_separator = 32);
+
+    // decode ctc from the logits before the final softmax with a simd argmax,
+    // false keeps the softmax and the old scalar decoder for comparison
+    void set_fast_ctc_decode(bool enabled);
+
+    // recognize crops wider than chunk_width as chunk_width chunks overlapping by chunk_overlap,
+    // run in parallel and stitched on the overlap, chunk_width = 0 disables
+    // verify also recognizes the whole line and counts agreement in the stats
+    void set_rec_chunking(int chunk_width, int chunk_overlap = 64, bool verify = false);
+
+    enum
+    {
+        // opencv lanczos warp, lanczos upscale of small text, then normalize
+        REC_CROP_LANCZOS = 0,
+        // single pass crop kernel writing the normalized tensor
+        REC_CROP_BILINEAR = 1,
+        REC_CROP_NEAREST = 2
+    };
+
+    void set_rec_crop_interpolation(int interpolation);
+
+    // recognize every line with the cheap crop interpolation first and re-run only lines
+    // whose mean character prob is below min_prob with the set crop interpolation
+    void set_rec_two_tier(bool enabled, float min_prob = 0.9f, int cheap_interpolation = REC_CROP_BILINEAR);
+
+    // reuse the text of near identical rec crops from an lru cache of up to max_bytes,
+    // grid_step is the signature cell width in pixels, max_bytes = 0 disables
+    // the cache is dropped whenever the models are loaded
+    void set_rec_cache(size_t max_bytes, int grid_step = 4);
+
+    // skip recognizing crops that hardly look like text, flat ones below min_contrast luma
+    // standard deviation and those with an edge density outside [min_edge_density, max_edge_density],
+    // luma and contrast are in rec input units where black to white spans 2
+    void set_text_filter(bool enabled, float min_contrast = 0.1f, float min_edge_density = 0.02f, float max_edge_density = 0.5f);
+
+    enum
+    {
+        // per image from line count and crop widths
+        REC_PARALLEL_AUTO = 0,
+        // one thread per forward, lines in parallel
+        REC_PARALLEL_LINES = 1,
+        // all big cores in every forward, lines one by one
+        REC_PARALLEL_INTRA = 2
+    };
+
+    // how the big cores are split between lines in parallel and threads inside one rec forward,
+    // auto gives spare cores to the forward of lines at least intra_min_width wide
+    void set_rec_parallelism(int mode, int intra_min_width = 192);
+
+    OcrStats get_stats() const;
+    void reset_stats();
+
     void set_dictionary(const std::vector<std::string>& dict);
     const std::string& get_char(int id) const;
 
+    // rgb is an RGB or RGBA image, row padded views are fine
     int detect(const cv::Mat& rgb, std::vector<Object>& objects);
 
+    // detection inside rois only, each roi is letterboxed on its own
+    // and objects are in full image coordinates
+    int detect(const cv::Mat& rgb, const std::vector<cv::Rect>& rois, std::vector<Object>& objects);
+
+    // single canvas detection that keeps the heatmap in session
+    int detect(const cv::Mat& rgb, DetectionSession& session, std::vector<Object>& objects);
+
+    // post processing only, with other parameters
+    int detect(const DetectionSession& session, const DetectionParams& params, std::vector<Object>& objects) const;
+
+    int detect_tiled(const cv::Mat& rgb, std::vector<Object>& objects);
+
+    int detect_coarse_to_fine(const cv::Mat& rgb, std::vector<Object>& objects);
+
     int recognize(const cv::Mat& rgb, Object& object);
 
+    // drop nested and heavily overlapping boxes, returns the number removed
+    int dedup(std::vector<Object>& objects);
+
+    // recognize all objects in parallel
+    int recognize(const cv::Mat& rgb, std::vector<Object>& objects);
+
     int detect_and_recognize(const cv::Mat& rgb, std::vector<Object>& objects);
 
+    int detect_and_recognize(const cv::Mat& rgb, const std::vector<cv::Rect>& rois, std::vector<Object>& objects);
+
+    // multi image mode, detection of the next image overlaps recognition of the current one
+    // fetch returns false when there are no more images, done gets results in fetch order
+    // both are called on the calling thread, an image must stay valid until its done returns
+    // fetch is not called while max_in_flight images are pending, returns the image count
+    int detect_and_recognize_pipelined(const std::function<bool(cv::Mat&)>& fetch, const std::function<void(int, std::vector<Object>&)>& done, int max_in_flight = 2);
+
+protected:
+    // run det on one canvas, boxes are returned before orientation fix and enlarge
+    // in the coordinates of rgb
+    int detect_boxes(const cv::Mat& rgb, int canvas_size, const DetectionParams& params, std::vector<Object>& boxes);
+
+    // coarse, tiled or single det of rgb without touching the text scale kept between images
+    // scale_side is the long side last_text_height_ratio is taken against, 0 for rgb itself
+    int detect_region(const cv::Mat& rgb, int scale_side, std::vector<Object>& objects);
+
+    int detect_single(const cv::Mat& rgb, int scale_side, std::vector<Object>& objects);
+
+    // det canvas for rgb, probe_boxes are filled and have_boxes set when the probe pass is already enough
+    int choose_target_size(const cv::Mat& rgb, int scale_side, std::vector<Object>& probe_boxes, bool& have_boxes);
+
+    int forward_det(const cv::Mat& rgb, int canvas_size, DetectionSession& session);
+    int session_boxes(const DetectionSession& session, const DetectionParams& params, std::vector<Object>& boxes) const;
+
+    // tiles of tile_size on the image scaled by scale, only tiles touching regions if given
+    int detect_tiles(const cv::Mat& rgb, float scale, int tile_size, const std::vector<cv::Rect>* regions, std::vector<Object>& objects);
+
+    // weights of one loaded net
+    struct LoadedModel
+    {
+        int precision;
+        int64_t model_bytes;
+        bool mapped;
+        bool cached;
+        GraphFusionReport fusion;
+
+        LoadedModel() : precision(0), model_bytes(0), mapped(false), cached(false) {}
+    };
+
+    // from assets when mgr is given, else from files
+    int load_models(AAssetManager* mgr, const char* det_parampath, const char* det_modelpath, const char* rec_parampath, const char* rec_modelpath, bool use_fp16, bool use_gpu);
+    int load_net(ncnn::Net& net, AAssetManager* mgr, const char* parampath, const char* modelpath, int precision, bool use_fp16, ModelMapping& weights, LoadedModel& loaded);
+    // a forward per arena at typical shapes
+    void warm_up_det();
+    void warm_up_rec(const std::vector<int>& buckets);
+
+    // block until the rec load is over, false when it failed
+    // setters of what the loader reads and the rec arena stats call it first
+    bool wait_rec() const;
+
+    // fused net from the model cache, fused and stored on a miss
+    int load_cached(ncnn::Net& net, const std::string& name, const std::string& param_text, ModelMapping& weights, LoadedModel& loaded);
+
+    // rec options per parallel mode and the blank extractors made from them, after loading
+    void init_rec_options();
+
+    // set the rec threads per forward for these task costs, returns the lines to run in parallel
+    int plan_rec_threads(const std::vector<float>& costs);
+
+    // opencv threads for the stage about to run, unless a pipelined run fixed them
+    void set_cv_threads(int threads) const;
+    // rec threads per forward for these task costs when lines forwards run at once
+    int rec_line_threads(const std::vector<float>& costs, int lines) const;
+
+    // recognize with the given REC_CROP_* interpolation
+    int recognize_line(const cv::Mat& rgb, Object& object, int interpolation);
+    int recognize_lines(const cv::Mat& rgb, std::vector<Object>& objects, int interpolation);
+
+    // true when the non text filter rejects the rec input, object is tagged skipped
+    bool reject_non_text(const ncnn::Mat& in, Object& object) const;
+    void count_text_filter(const std::vector<Object>& objects);
+
+    // cached text of a rec input into object, key is filled for rec_cache_store on a miss
+    bool rec_cache_lookup(const ncnn::Mat& in, int interpolation, RecCacheKey& key, Object& object);
+    void rec_cache_store(const RecCacheKey& key, const Object& object);
+
+    // normalized rec input of one object, -1 when the crop is empty
+    int rec_input(const cv::Mat& rgb, const Object& object, int interpolation, ncnn::Mat& in);
+
+    // pad in to its width bucket and run rec, returns the bucket
+    int forward_rec(ncnn::Mat& in, ncnn::Mat& out);
+
+    // ctc decode time steps [begin, end) of out into object, with the step of every character if steps is given
+    void decode_ctc(const ncnn::Mat& out, int begin, int end, Object& object, std::vector<int>* steps = 0);
+
+    // padded width of bucket for a crop of height, bucket index for a crop
+    // or the bucket count when it fits none
+    int bucket_width(int bucket, int height) const;
+    int find_width_bucket(int width, int height) const;
+
+    // scratch buffers of the calling omp thread or rec worker
+    ScratchArena& det_arena() const;
+    ScratchArena& rec_arena() const;
+
 protected:
     ncnn::Net ppocrv5_det;
     ncnn::Net ppocrv5_rec;
     int target_size;
+    int tile_size;
+    int tile_overlap;
+    int tile_max_side;
+    int coarse_size;
+    int coarse_tile_size;
+    DetectionParams det_params;
+    float coarse_box_thresh;
+    float dedup_overlap;
+    int pack_width;
+    int pack_line_width;
+    int pack_separator;
+    bool fast_ctc_decode;
+    bool text_filter;
+    float text_filter_min_contrast;
+    float text_filter_min_edge_density;
+    float text_filter_max_edge_density;
+    int chunk_width;
+    int chunk_overlap;
+    bool chunk_verify;
+    int rec_crop_interpolation;
+    bool two_tier;
+    float two_tier_min_prob;
+    int two_tier_interpolation;
+    // rec blob feeding the output softmax, -1 if the model has none
+    int rec_logits_blob;
+    int rec_parallel_mode;
+    int rec_intra_min_width;
+    ncnn::Option rec_lines_opt;
+    ncnn::Option rec_intra_opt;
+    // blank rec extractors for 1 .. rec_pool threads, and the thread count of the current pass
+    std::vector<ncnn::Extractor> rec_extractors;
+    int rec_pass_threads;
+    int adaptive_size_mode;
+    float adaptive_min_text_height;
+    int adaptive_probe_size;
+    int adaptive_max_size;
+    // median text height over long side of the last image
+    float last_text_height_ratio;
+    // the opencv thread count is fixed for a pipelined run and the stages leave it alone
+    bool cv_threads_pinned;
+    OcrStats stats;
+    // per thread buffers reused across calls
+    std::vector<ScratchArena*> det_arenas;
+    std::vector<ScratchArena*> rec_arenas;
+    std::vector<int> rec_width_buckets;
+    bool graph_fusion;
+    int det_precision;
+    int rec_precision;
+    LoadedModel det_model;
+    LoadedModel rec_model;
+    // weights ncnn may reference in place, kept until the next load
+    ModelMapping det_weights;
+    ModelMapping rec_weights;
+    ModelCache model_cache;
+    double load_time;
+    int64_t load_peak_rss;
+    bool background_rec_load;
+    bool warm_up;
+    std::atomic<int> det_state;
+    std::atomic<int> rec_state;
+    double rec_ready_time;
+    std::thread rec_loader;
+    mutable std::mutex rec_state_lock;
+    mutable std::condition_variable rec_state_changed;
+    // persistent rec workers
+    TaskPool rec_pool;
+    RecCache rec_cache;
+    // bumped by every load, part of the rec cache signatures
+    uint64_t rec_model_generation;
     std::vector<std::string> dictionary;
 };
 
@@ -0,0 +1,398 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "preprocess.h"
+
+#include <algorithm>
+
+#include <math.h>
+
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif // __ARM_NEON
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+// outptr[i] = (rows0[i] * b0 + rows1[i] * b1) * norm + bias
+static void vresize_normalize(const float* rows0, const float* rows1, float b0, float b1, float norm, float bias, float* outptr, int w)
+{
+    int i = 0;
+#if __ARM_NEON
+    float32x4_t _b0 = vdupq_n_f32(b0 * norm);
+    float32x4_t _b1 = vdupq_n_f32(b1 * norm);
+    float32x4_t _bias = vdupq_n_f32(bias);
+    for (; i + 3 < w; i += 4)
+    {
+        float32x4_t _v = vmlaq_f32(_bias, vld1q_f32(rows0 + i), _b0);
+        _v = vmlaq_f32(_v, vld1q_f32(rows1 + i), _b1);
+        vst1q_f32(outptr + i, _v);
+    }
+#elif __SSE2__
+    __m128 _b0 = _mm_set1_ps(b0 * norm);
+    __m128 _b1 = _mm_set1_ps(b1 * norm);
+    __m128 _bias = _mm_set1_ps(bias);
+    for (; i + 3 < w; i += 4)
+    {
+        __m128 _v = _mm_add_ps(_bias, _mm_mul_ps(_mm_loadu_ps(rows0 + i), _b0));
+        _v = _mm_add_ps(_v, _mm_mul_ps(_mm_loadu_ps(rows1 + i), _b1));
+        _mm_storeu_ps(outptr + i, _v);
+    }
+#endif
+    for (; i < w; i++)
+    {
+        outptr[i] = (rows0[i] * b0 + rows1[i] * b1) * norm + bias;
+    }
+}
+
+// deinterleave one source row without resize
+static void row_normalize(const unsigned char* ptr, int channels, int w, const float* norm, const float* bias, float* outb, float* outg, float* outr)
+{
+    int i = 0;
+#if __ARM_NEON
+    float32x4_t _norm_b = vdupq_n_f32(norm[0]);
+    float32x4_t _norm_g = vdupq_n_f32(norm[1]);
+    float32x4_t _norm_r = vdupq_n_f32(norm[2]);
+    float32x4_t _bias_b = vdupq_n_f32(bias[0]);
+    float32x4_t _bias_g = vdupq_n_f32(bias[1]);
+    float32x4_t _bias_r = vdupq_n_f32(bias[2]);
+    for (; i + 7 < w; i += 8)
+    {
+        uint8x8_t _r8;
+        uint8x8_t _g8;
+        uint8x8_t _b8;
+        if (channels == 4)
+        {
+            uint8x8x4_t _rgba = vld4_u8(ptr + i * 4);
+            _r8 = _rgba.val[0];
+            _g8 = _rgba.val[1];
+            _b8 = _rgba.val[2];
+        }
+        else
+        {
+            uint8x8x3_t _rgb = vld3_u8(ptr + i * 3);
+            _r8 = _rgb.val[0];
+            _g8 = _rgb.val[1];
+            _b8 = _rgb.val[2];
+        }
+
+        uint16x8_t _r16 = vmovl_u8(_r8);
+        uint16x8_t _g16 = vmovl_u8(_g8);
+        uint16x8_t _b16 = vmovl_u8(_b8);
+
+        vst1q_f32(outr + i, vmlaq_f32(_bias_r, vcvtq_f32_u32(vmovl_u16(vget_low_u16(_r16))), _norm_r));
+        vst1q_f32(outr + i + 4, vmlaq_f32(_bias_r, vcvtq_f32_u32(vmovl_u16(vget_high_u16(_r16))), _norm_r));
+        vst1q_f32(outg + i, vmlaq_f32(_bias_g, vcvtq_f32_u32(vmovl_u16(vget_low_u16(_g16))), _norm_g));
+        vst1q_f32(outg + i + 4, vmlaq_f32(_bias_g, vcvtq_f32_u32(vmovl_u16(vget_high_u16(_g16))), _norm_g));
+        vst1q_f32(outb + i, vmlaq_f32(_bias_b, vcvtq_f32_u32(vmovl_u16(vget_low_u16(_b16))), _norm_b));
+        vst1q_f32(outb + i + 4, vmlaq_f32(_bias_b, vcvtq_f32_u32(vmovl_u16(vget_high_u16(_b16))), _norm_b));
+    }
+#endif // __ARM_NEON
+    for (; i < w; i++)
+    {
+        const unsigned char* p = ptr + i * channels;
+        outr[i] = p[0] * norm[2] + bias[2];
+        outg[i] = p[1] * norm[1] + bias[1];
+        outb[i] = p[2] * norm[0] + bias[0];
+    }
+}
+
+void letterbox_to_tensor(const cv::Mat& rgb, int target_w, int target_h, int left, int top, int canvas_w, int canvas_h, float pad_value, const float* mean_vals, const float* norm_vals, ncnn::Mat& out, ncnn::Allocator* allocator)
+{
+    const int w = rgb.cols;
+    const int h = rgb.rows;
+    const int channels = rgb.channels();
+
+    out.create(canvas_w, canvas_h, 3, 4u, allocator);
+    if (out.empty())
+        return;
+
+    // (v - mean) * norm == v * norm + bias
+    float bias[3];
+    for (int q = 0; q < 3; q++)
+    {
+        bias[q] = -mean_vals[q] * norm_vals[q];
+    }
+
+    // border
+    for (int q = 0; q < 3; q++)
+    {
+        const float v = (pad_value - mean_vals[q]) * norm_vals[q];
+
+        ncnn::Mat m = out.channel(q);
+        for (int y = 0; y < canvas_h; y++)
+        {
+            float* outptr = m.row(y);
+            if (y < top || y >= top + target_h)
+            {
+                std::fill(outptr, outptr + canvas_w, v);
+                continue;
+            }
+            std::fill(outptr, outptr + left, v);
+            std::fill(outptr + left + target_w, outptr + canvas_w, v);
+        }
+    }
+
+    if (target_w == w && target_h == h)
+    {
+        for (int y = 0; y < h; y++)
+        {
+            row_normalize(rgb.ptr<unsigned char>(y), channels, w, norm_vals, bias, out.channel(0).row(top + y) + left, out.channel(1).row(top + y) + left, out.channel(2).row(top + y) + left);
+        }
+        return;
+    }
+
+    // bilinear, pixel centers aligned as in ncnn resize_bilinear
+    const float scale_x = (float)w / target_w;
+    const float scale_y = (float)h / target_h;
+
+    // offsets, weights and two cached rows, from the output allocator so an arena reuses them
+    ncnn::Mat scratch(target_w * 9, (size_t)4u, allocator);
+    int* xofs = (int*)scratch.data;
+    float* alpha = (float*)scratch.data + target_w * 2;
+    for (int dx = 0; dx < target_w; dx++)
+    {
+        float fx = (dx + 0.5f) * scale_x - 0.5f;
+        int sx = (int)floorf(fx);
+        fx -= sx;
+        if (sx < 0)
+        {
+            sx = 0;
+            fx = 0.f;
+        }
+        if (sx >= w - 1)
+        {
+            sx = w - 1;
+            fx = 0.f;
+        }
+        xofs[dx * 2] = sx * channels;
+        xofs[dx * 2 + 1] = std::min(sx + 1, w - 1) * channels;
+        alpha[dx] = fx;
+    }
+
+    // horizontally resized source rows, planar rgb, two rows cached
+    float* rows[2] = {alpha + target_w, alpha + target_w * 4};
+    int rows_sy[2] = {-1, -1};
+
+    for (int dy = 0; dy < target_h; dy++)
+    {
+        float fy = (dy + 0.5f) * scale_y - 0.5f;
+        int sy = (int)floorf(fy);
+        fy -= sy;
+        if (sy < 0)
+        {
+            sy = 0;
+            fy = 0.f;
+        }
+        if (sy >= h - 1)
+        {
+            sy = h - 1;
+            fy = 0.f;
+        }
+        const int sy1 = std::min(sy + 1, h - 1);
+
+        for (int k = 0; k < 2; k++)
+        {
+            const int ry = k == 0 ? sy : sy1;
+            if (rows_sy[0] == ry || rows_sy[1] == ry)
+                continue;
+
+            // reuse the slot not holding the other row we need
+            const int other = k == 0 ? sy1 : sy;
+            const int slot = rows_sy[0] == other ? 1 : 0;
+
+            const unsigned char* ptr = rgb.ptr<unsigned char>(ry);
+            float* rowr = rows[slot];
+            float* rowg = rowr + target_w;
+            float* rowb = rowg + target_w;
+            for (int dx = 0; dx < target_w; dx++)
+            {
+                const unsigned char* p0 = ptr + xofs[dx * 2];
+                const unsigned char* p1 = ptr + xofs[dx * 2 + 1];
+                const float a1 = alpha[dx];
+                const float a0 = 1.f - a1;
+                rowr[dx] = p0[0] * a0 + p1[0] * a1;
+                rowg[dx] = p0[1] * a0 + p1[1] * a1;
+                rowb[dx] = p0[2] * a0 + p1[2] * a1;
+            }
+            rows_sy[slot] = ry;
+        }
+
+        const float* rows0 = rows[rows_sy[0] == sy ? 0 : 1];
+        const float* rows1 = rows[rows_sy[0] == sy1 ? 0 : 1];
+
+        // planar source is rgb, output is bgr
+        for (int q = 0; q < 3; q++)
+        {
+            const int plane = 2 - q;
+            vresize_normalize(rows0 + plane * target_w, rows1 + plane * target_w, 1.f - fy, fy, norm_vals[q], bias[q], out.channel(q).row(top + dy) + left, target_w);
+        }
+    }
+}
+
+// source pixel pair and weight of the second one around s
+static inline void sample_pair(float s, int size, bool nearest, int& i0, int& i1, float& a)
+{
+    if (nearest)
+    {
+        i0 = std::min(std::max((int)floorf(s + 0.5f), 0), size - 1);
+        i1 = i0;
+        a = 0.f;
+        return;
+    }
+
+    const int i = (int)floorf(s);
+    a = s - i;
+    i0 = std::min(std::max(i, 0), size - 1);
+    i1 = std::min(std::max(i + 1, 0), size - 1);
+}
+
+// bilinear sample of one pixel, written as BGR
+static inline void sample_bgr(const unsigned char* row0, const unsigned char* row1, int x0, int x1, float ax, float ay, int channels, const float* norm_vals, const float* bias, float* outb, float* outg, float* outr)
+{
+    const unsigned char* p00 = row0 + x0 * channels;
+    const unsigned char* p01 = row0 + x1 * channels;
+    const unsigned char* p10 = row1 + x0 * channels;
+    const unsigned char* p11 = row1 + x1 * channels;
+
+    float v[3];
+    for (int c = 0; c < 3; c++)
+    {
+        const float top = p00[c] + (p01[c] - p00[c]) * ax;
+        const float bottom = p10[c] + (p11[c] - p10[c]) * ax;
+        v[c] = top + (bottom - top) * ay;
+    }
+
+    *outb = v[2] * norm_vals[0] + bias[0];
+    *outg = v[1] * norm_vals[1] + bias[1];
+    *outr = v[0] * norm_vals[2] + bias[2];
+}
+
+void crop_to_tensor(const cv::Mat& rgb, const float* m, int out_w, int out_h, int interpolation, const float* mean_vals, const float* norm_vals, ncnn::Mat& out, ncnn::Allocator* allocator)
+{
+    const int w = rgb.cols;
+    const int h = rgb.rows;
+    const int channels = rgb.channels();
+    const bool nearest = interpolation == CROP_NEAREST;
+
+    out.create(out_w, out_h, 3, 4u, allocator);
+    if (out.empty())
+        return;
+
+    float bias[3];
+    for (int q = 0; q < 3; q++)
+    {
+        bias[q] = -mean_vals[q] * norm_vals[q];
+    }
+
+    ncnn::Mat outb_m = out.channel(0);
+    ncnn::Mat outg_m = out.channel(1);
+    ncnn::Mat outr_m = out.channel(2);
+
+    const float eps = 1e-4f;
+    const bool axis_aligned = fabsf(m[1]) < eps && fabsf(m[3]) < eps;
+    const bool transposed = fabsf(m[0]) < eps && fabsf(m[4]) < eps;
+
+    for (int y = 0; y < out_h; y++)
+    {
+        float* outb = outb_m.row(y);
+        float* outg = outg_m.row(y);
+        float* outr = outr_m.row(y);
+
+        if (axis_aligned)
+        {
+            // source rows are fixed for the whole output row, a scaled strided copy
+            int y0, y1;
+            float ay;
+            sample_pair(m[4] * y + m[5], h, nearest, y0, y1, ay);
+
+            const unsigned char* row0 = rgb.ptr<const unsigned char>(y0);
+            const unsigned char* row1 = rgb.ptr<const unsigned char>(y1);
+            for (int x = 0; x < out_w; x++)
+            {
+                int x0, x1;
+                float ax;
+                sample_pair(m[0] * x + m[2], w, nearest, x0, x1, ax);
+
+                sample_bgr(row0, row1, x0, x1, ax, ay, channels, norm_vals, bias, outb + x, outg + x, outr + x);
+            }
+        }
+        else if (transposed)
+        {
+            // vertical text, the output row walks down a source column pair
+            int x0, x1;
+            float ax;
+            sample_pair(m[1] * y + m[2], w, nearest, x0, x1, ax);
+
+            for (int x = 0; x < out_w; x++)
+            {
+                int y0, y1;
+                float ay;
+                sample_pair(m[3] * x + m[5], h, nearest, y0, y1, ay);
+
+                sample_bgr(rgb.ptr<const unsigned char>(y0), rgb.ptr<const unsigned char>(y1), x0, x1, ax, ay, channels, norm_vals, bias, outb + x, outg + x, outr + x);
+            }
+        }
+        else
+        {
+            for (int x = 0; x < out_w; x++)
+            {
+                int x0, x1, y0, y1;
+                float ax, ay;
+                sample_pair(m[0] * x + m[1] * y + m[2], w, nearest, x0, x1, ax);
+                sample_pair(m[3] * x + m[4] * y + m[5], h, nearest, y0, y1, ay);
+
+                sample_bgr(rgb.ptr<const unsigned char>(y0), rgb.ptr<const unsigned char>(y1), x0, x1, ax, ay, channels, norm_vals, bias, outb + x, outg + x, outr + x);
+            }
+        }
+    }
+}
+
+void crop_text_features(const ncnn::Mat& in, float edge_step, float& contrast, float& edge_density)
+{
+    contrast = 0.f;
+    edge_density = 0.f;
+
+    if (in.w < 2 || in.h < 1 || in.c < 3)
+        return;
+
+    double sum = 0.0;
+    double sqsum = 0.0;
+    int edges = 0;
+
+    for (int y = 0; y < in.h; y++)
+    {
+        const float* p0 = in.channel(0).row(y);
+        const float* p1 = in.channel(1).row(y);
+        const float* p2 = in.channel(2).row(y);
+
+        float prev = (p0[0] + p1[0] + p2[0]) * (1.f / 3);
+        sum += prev;
+        sqsum += prev * prev;
+
+        for (int x = 1; x < in.w; x++)
+        {
+            const float v = (p0[x] + p1[x] + p2[x]) * (1.f / 3);
+            sum += v;
+            sqsum += v * v;
+            edges += fabsf(v - prev) > edge_step ? 1 : 0;
+            prev = v;
+        }
+    }
+
+    const double n = (double)in.w * in.h;
+    const double mean = sum / n;
+    contrast = (float)sqrt(std::max(sqsum / n - mean * mean, 0.0));
+    edge_density = (float)edges / ((in.w - 1) * in.h);
+}
@@ -0,0 +1,45 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+#include <opencv2/core/core.hpp>
+
+#include <mat.h>
+
+// bilinear resize an RGB or RGBA view (any row stride) to target_w x target_h,
+// place it at (left, top) on a canvas_w x canvas_h canvas filled with pad_value
+// and write (v - mean) * norm as a BGR planar tensor, all in one pass
+// mean_vals and norm_vals are in output channel order
+void letterbox_to_tensor(const cv::Mat& rgb, int target_w, int target_h, int left, int top, int canvas_w, int canvas_h, float pad_value, const float* mean_vals, const float* norm_vals, ncnn::Mat& out, ncnn::Allocator* allocator = 0);
+
+enum
+{
+    CROP_NEAREST = 0,
+    CROP_BILINEAR = 1
+};
+
+// resample an RGB or RGBA view through the affine map
+// src_x = m[0] * x + m[1] * y + m[2], src_y = m[3] * x + m[4] * y + m[5]
+// into an out_w x out_h tensor of (v - mean) * norm in BGR planar order
+// axis aligned and 90 degree maps get their own loops, out of image samples replicate the border
+void crop_to_tensor(const cv::Mat& rgb, const float* m, int out_w, int out_h, int interpolation, const float* mean_vals, const float* norm_vals, ncnn::Mat& out, ncnn::Allocator* allocator = 0);
+
+// luma statistics of a 3 channel planar tensor for telling text from flat areas and texture
+// contrast is the luma standard deviation, edge_density the fraction of horizontally
+// neighbouring pixels whose luma differs by more than edge_step
+void crop_text_features(const ncnn::Mat& in, float edge_step, float& contrast, float& edge_density);
+
+#endif // PREPROCESS_H
@@ -0,0 +1,234 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rec_cache.h"
+
+#include <algorithm>
+
+static const int signature_bands = 8;
+
+static inline uint64_t fnv1a(uint64_t hash, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+RecCache::RecCache()
+{
+    max_bytes = 0;
+    grid_step = 4;
+    used_bytes = 0;
+    hit_count = 0;
+    miss_count = 0;
+}
+
+void RecCache::set_capacity(size_t _max_bytes, int _grid_step)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    max_bytes = _max_bytes;
+    if (grid_step != std::max(_grid_step, 1))
+    {
+        // signatures on another grid never match again
+        lru.clear();
+        index.clear();
+        used_bytes = 0;
+        grid_step = std::max(_grid_step, 1);
+    }
+
+    evict();
+}
+
+bool RecCache::enabled() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return max_bytes > 0;
+}
+
+void RecCache::signature(const ncnn::Mat& in, uint64_t salt, RecCacheKey& key) const
+{
+    int step;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        step = grid_step;
+    }
+
+    const int w = in.w;
+    const int h = in.h;
+    const int cols = std::max((w + step - 1) / step, 1);
+
+    // luma sum per band and cell
+    std::vector<float> cells(signature_bands * cols, 0.f);
+    for (int q = 0; q < in.c; q++)
+    {
+        const ncnn::Mat channel = in.channel(q);
+        for (int y = 0; y < h; y++)
+        {
+            const float* ptr = channel.row(y);
+            float* band = &cells[std::min(y * signature_bands / h, signature_bands - 1) * cols];
+            for (int x = 0; x < w; x++)
+            {
+                band[x / step] += ptr[x];
+            }
+        }
+    }
+
+    // cell means, the last cell of a band may be narrower
+    const float band_rows = (float)h / signature_bands;
+    for (int b = 0; b < signature_bands; b++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            const int cell_w = std::min(step, w - c * step);
+            cells[b * cols + c] /= band_rows * std::max(cell_w, 1);
+        }
+    }
+
+    const int nbits = signature_bands * (cols - 1);
+
+    key.w = w;
+    key.h = h;
+    key.bits.assign((nbits + 63) / 64, 0);
+
+    int bit = 0;
+    for (int b = 0; b < signature_bands; b++)
+    {
+        for (int c = 0; c + 1 < cols; c++, bit++)
+        {
+            if (cells[b * cols + c] > cells[b * cols + c + 1])
+                key.bits[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    uint64_t hash = fnv1a(0xcbf29ce484222325ULL, salt);
+    hash = fnv1a(hash, ((uint64_t)w << 32) | (uint32_t)h);
+    for (size_t i = 0; i < key.bits.size(); i++)
+    {
+        hash = fnv1a(hash, key.bits[i]);
+    }
+    key.hash = hash;
+}
+
+bool RecCache::lookup(const RecCacheKey& key, std::vector<int>& ids, std::vector<float>& probs)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it = index.find(key.hash);
+
+    // a hash collision between different signatures is a miss
+    if (it == index.end() || it->second->key.w != key.w || it->second->key.h != key.h || it->second->key.bits != key.bits)
+    {
+        miss_count++;
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, it->second);
+
+    ids = it->second->ids;
+    probs = it->second->probs;
+
+    hit_count++;
+    return true;
+}
+
+void RecCache::insert(const RecCacheKey& key, const std::vector<int>& ids, const std::vector<float>& probs)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (max_bytes == 0)
+        return;
+
+    std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it = index.find(key.hash);
+    if (it != index.end())
+    {
+        used_bytes -= it->second->bytes;
+        lru.erase(it->second);
+        index.erase(it);
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.ids = ids;
+    entry.probs = probs;
+    // list and map nodes included
+    entry.bytes = sizeof(Entry) + 64 + key.bits.size() * sizeof(uint64_t) + ids.size() * (sizeof(int) + sizeof(float));
+
+    lru.push_front(entry);
+    index[key.hash] = lru.begin();
+    used_bytes += entry.bytes;
+
+    evict();
+}
+
+void RecCache::clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    lru.clear();
+    index.clear();
+    used_bytes = 0;
+    hit_count = 0;
+    miss_count = 0;
+}
+
+void RecCache::reset_counters()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    hit_count = 0;
+    miss_count = 0;
+}
+
+int64_t RecCache::hits() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return hit_count;
+}
+
+int64_t RecCache::misses() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return miss_count;
+}
+
+int RecCache::entries() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return (int)lru.size();
+}
+
+size_t RecCache::bytes() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return used_bytes;
+}
+
+void RecCache::evict()
+{
+    while (!lru.empty() && used_bytes > max_bytes)
+    {
+        used_bytes -= lru.back().bytes;
+        index.erase(lru.back().key.hash);
+        lru.pop_back();
+    }
+}
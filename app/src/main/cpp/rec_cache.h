@@ -0,0 +1,97 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REC_CACHE_H
+#define REC_CACHE_H
+
+#include <mat.h>
+
+#include <stdint.h>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// perceptual signature of a normalized rec input
+// luma cell means over 8 horizontal bands, one bit per pair of neighbouring cells
+struct RecCacheKey
+{
+    uint64_t hash;
+    int w;
+    int h;
+    std::vector<uint64_t> bits;
+
+    RecCacheKey() : hash(0), w(0), h(0)
+    {
+    }
+};
+
+// lru cache of recognized text keyed by rec input signatures
+// near identical crops share a signature and skip the rec forward pass
+class RecCache
+{
+public:
+    RecCache();
+
+    // max_bytes = 0 disables the cache and drops every entry
+    // grid_step is the cell width in input pixels, a coarser grid merges more near duplicates
+    void set_capacity(size_t max_bytes, int grid_step);
+
+    bool enabled() const;
+
+    // salt keeps signatures of different models and crop settings apart
+    void signature(const ncnn::Mat& in, uint64_t salt, RecCacheKey& key) const;
+
+    // ids and probs of the cached text, false on a miss
+    bool lookup(const RecCacheKey& key, std::vector<int>& ids, std::vector<float>& probs);
+    void insert(const RecCacheKey& key, const std::vector<int>& ids, const std::vector<float>& probs);
+
+    void clear();
+
+    // hits and misses since the last reset_counters() or clear()
+    void reset_counters();
+    int64_t hits() const;
+    int64_t misses() const;
+    int entries() const;
+    // estimated bytes held by the entries
+    size_t bytes() const;
+
+protected:
+    struct Entry
+    {
+        RecCacheKey key;
+        std::vector<int> ids;
+        std::vector<float> probs;
+        size_t bytes;
+    };
+
+    void evict();
+
+protected:
+    mutable std::mutex lock;
+
+    size_t max_bytes;
+    int grid_step;
+
+    // most recently used first
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t used_bytes;
+
+    int64_t hit_count;
+    int64_t miss_count;
+};
+
+#endif // REC_CACHE_H
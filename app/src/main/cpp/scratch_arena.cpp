@@ -0,0 +1,202 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "scratch_arena.h"
+
+#include <algorithm>
+
+ScratchAllocator::ScratchAllocator()
+{
+    allocation_count = 0;
+    reserved = 0;
+}
+
+ScratchAllocator::~ScratchAllocator()
+{
+    clear();
+
+    // blocks still in use are leaked on purpose, their mats outlived the allocator
+}
+
+void* ScratchAllocator::fastMalloc(size_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    // smallest idle block that fits
+    int best = -1;
+    for (int i = 0; i < (int)idle_blocks.size(); i++)
+    {
+        if (idle_blocks[i].size >= size && (best == -1 || idle_blocks[i].size < idle_blocks[best].size))
+            best = i;
+    }
+
+    if (best == -1 && !idle_blocks.empty())
+    {
+        // nothing fits, grow the largest idle block instead of adding one
+        best = 0;
+        for (int i = 1; i < (int)idle_blocks.size(); i++)
+        {
+            if (idle_blocks[i].size > idle_blocks[best].size)
+                best = i;
+        }
+
+        Block& b = idle_blocks[best];
+        ncnn::fastFree(b.ptr);
+        reserved -= b.size;
+
+        b.ptr = ncnn::fastMalloc(size);
+        b.size = size;
+        reserved += size;
+        allocation_count++;
+    }
+
+    if (best == -1)
+    {
+        Block b;
+        b.ptr = ncnn::fastMalloc(size);
+        b.size = size;
+        reserved += size;
+        allocation_count++;
+
+        used_blocks.push_back(b);
+        return b.ptr;
+    }
+
+    Block b = idle_blocks[best];
+    idle_blocks[best] = idle_blocks.back();
+    idle_blocks.pop_back();
+
+    used_blocks.push_back(b);
+    return b.ptr;
+}
+
+void ScratchAllocator::fastFree(void* ptr)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (size_t i = 0; i < used_blocks.size(); i++)
+    {
+        if (used_blocks[i].ptr == ptr)
+        {
+            idle_blocks.push_back(used_blocks[i]);
+            used_blocks[i] = used_blocks.back();
+            used_blocks.pop_back();
+            return;
+        }
+    }
+
+    // not ours
+    ncnn::fastFree(ptr);
+}
+
+void ScratchAllocator::clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (size_t i = 0; i < idle_blocks.size(); i++)
+    {
+        ncnn::fastFree(idle_blocks[i].ptr);
+        reserved -= idle_blocks[i].size;
+    }
+    idle_blocks.clear();
+}
+
+int64_t ScratchAllocator::allocations() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return allocation_count;
+}
+
+int64_t ScratchAllocator::reserved_bytes() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return reserved;
+}
+
+void ScratchAllocator::reset_counters()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    allocation_count = 0;
+}
+
+ScratchArena::ScratchArena()
+{
+    decode_time = 0.0;
+    decode_steps = 0;
+    crop_time = 0.0;
+    forwards = 0;
+    forward_time = 0.0;
+    growths = 0;
+}
+
+ncnn::Extractor ScratchArena::extractor(const ncnn::Net& net)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_blob_allocator(&blob_allocator);
+    ex.set_workspace_allocator(&workspace_allocator);
+    return ex;
+}
+
+ncnn::Extractor ScratchArena::extractor(const ncnn::Extractor& blank)
+{
+    ncnn::Extractor ex = blank;
+    ex.set_blob_allocator(&blob_allocator);
+    ex.set_workspace_allocator(&workspace_allocator);
+    return ex;
+}
+
+cv::Mat ScratchArena::mat(cv::Mat& buffer, int rows, int cols, int type)
+{
+    const size_t size = (size_t)rows * cols * CV_ELEM_SIZE(type);
+    if (buffer.empty() || buffer.total() < size)
+    {
+        // leave headroom so slightly larger crops do not regrow
+        buffer.create(1, (int)std::max(size + size / 4, (size_t)4096), CV_8UC1);
+        growths++;
+    }
+
+    return cv::Mat(rows, cols, type, buffer.data);
+}
+
+int64_t ScratchArena::allocations() const
+{
+    return growths + db_postprocess.allocations() + blob_allocator.allocations() + workspace_allocator.allocations();
+}
+
+int64_t ScratchArena::reserved_bytes() const
+{
+    const int64_t buffers = (int64_t)crop_buffer.total() + (int64_t)upscale_buffer.total();
+    return buffers + blob_allocator.reserved_bytes() + workspace_allocator.reserved_bytes();
+}
+
+void ScratchArena::reset_counters()
+{
+    growths = 0;
+    db_postprocess.reset_counters();
+    blob_allocator.reset_counters();
+    workspace_allocator.reset_counters();
+}
+
+void ScratchArena::clear()
+{
+    crop_buffer.release();
+    upscale_buffer.release();
+    line_inputs.clear();
+    for (size_t i = 0; i < bucket_inputs.size(); i++)
+    {
+        bucket_inputs[i].release();
+    }
+    blob_allocator.clear();
+    workspace_allocator.clear();
+}
@@ -0,0 +1,138 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <opencv2/core/core.hpp>
+
+#include <allocator.h>
+#include <mat.h>
+#include <net.h>
+
+#include "db_postprocess.h"
+#include "rec_cache.h"
+
+#include <mutex>
+#include <vector>
+
+// ncnn allocator keeping freed blocks for reuse
+// a request takes the smallest free block that fits, when none fits
+// the largest free block is replaced by a bigger one, so the pool only
+// grows to the peak working set and then stops allocating
+class ScratchAllocator : public ncnn::Allocator
+{
+public:
+    ScratchAllocator();
+    virtual ~ScratchAllocator();
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+    // free all idle blocks
+    void clear();
+
+    // blocks allocated from the system since the last reset_counters()
+    int64_t allocations() const;
+    // bytes held in blocks, idle or in use
+    int64_t reserved_bytes() const;
+    void reset_counters();
+
+protected:
+    struct Block
+    {
+        void* ptr;
+        size_t size;
+    };
+
+    mutable std::mutex lock;
+    std::vector<Block> idle_blocks;
+    std::vector<Block> used_blocks;
+    int64_t allocation_count;
+    int64_t reserved;
+};
+
+// buffers of one pipeline stage on one thread, reused across calls
+// nothing in here may be touched by two threads at the same time
+class ScratchArena
+{
+public:
+    ScratchArena();
+
+    // extractor of net on the arena allocators
+    // a cleared ncnn extractor drops its blob table and can not take input again,
+    // so every forward gets a fresh one and only the allocators carry over
+    ncnn::Extractor extractor(const ncnn::Net& net);
+
+    // copy of a blank extractor on the arena allocators, keeps the options it was made with
+    ncnn::Extractor extractor(const ncnn::Extractor& blank);
+
+    // header of rows x cols of type over buffer, buffer grows when too small
+    cv::Mat mat(cv::Mat& buffer, int rows, int cols, int type);
+
+    // clear v and make room for n elements
+    template<typename T>
+    void reserve(std::vector<T>& v, size_t n)
+    {
+        v.clear();
+        if (v.capacity() < n)
+        {
+            v.reserve(n);
+            growths++;
+        }
+    }
+
+    int64_t allocations() const;
+    int64_t reserved_bytes() const;
+    void reset_counters();
+    void clear();
+
+public:
+    // ncnn blobs, the workspace allocator is not shared with other threads
+    ScratchAllocator blob_allocator;
+    ScratchAllocator workspace_allocator;
+
+    // det
+    DBPostProcess db_postprocess;
+    std::vector<DBBox> db_boxes;
+    std::vector<float> box_heights;
+
+    // rec
+    cv::Mat crop_buffer;
+    cv::Mat upscale_buffer;
+    std::vector<int> tokens;
+    std::vector<float> scores;
+
+    // per line state of one recognize_lines call
+    std::vector<float> line_costs;
+    std::vector<ncnn::Mat> line_inputs;
+    std::vector<RecCacheKey> line_keys;
+
+    // rec input per width bucket, and per bucket hits / time in ms
+    std::vector<ncnn::Mat> bucket_inputs;
+    std::vector<int64_t> bucket_hits;
+    std::vector<double> bucket_time;
+    double decode_time;
+    int64_t decode_steps;
+    double crop_time;
+
+    // net forward passes on this arena and their time in ms
+    int64_t forwards;
+    double forward_time;
+
+protected:
+    int64_t growths;
+};
+
+#endif // SCRATCH_ARENA_H
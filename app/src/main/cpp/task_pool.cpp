@@ -0,0 +1,223 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "task_pool.h"
+
+#include <algorithm>
+
+static thread_local int g_worker_index = 0;
+
+TaskPool::TaskPool()
+{
+    generation = 0;
+    stopping = false;
+    current_task = 0;
+    active_threads = 0;
+    remaining = 0;
+    busy_workers = 0;
+}
+
+TaskPool::~TaskPool()
+{
+    stop();
+}
+
+void TaskPool::start(int num_threads)
+{
+    stop();
+
+    num_threads = std::max(num_threads, 1);
+    for (int i = 0; i < num_threads; i++)
+    {
+        queues.push_back(new Queue);
+        queues[i]->head = 0;
+    }
+
+    stopping = false;
+
+    // slot 0 is the caller of run()
+    for (int i = 1; i < num_threads; i++)
+    {
+        threads.push_back(std::thread(&TaskPool::worker, this, i));
+    }
+}
+
+void TaskPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    threads.clear();
+
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+        delete queues[i];
+    }
+    queues.clear();
+}
+
+int TaskPool::num_threads() const
+{
+    return std::max((int)queues.size(), 1);
+}
+
+int TaskPool::worker_index()
+{
+    return g_worker_index;
+}
+
+void TaskPool::run(int count, const std::vector<float>& costs, const std::function<void(int)>& task, int max_threads)
+{
+    if (count <= 0)
+        return;
+
+    std::lock_guard<std::mutex> run_guard(run_lock);
+
+    std::vector<int> order(count);
+    for (int i = 0; i < count; i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&costs](int a, int b) {
+        return costs[a] > costs[b];
+    });
+
+    const int n = max_threads > 0 ? std::min(max_threads, (int)queues.size()) : (int)queues.size();
+
+    if (n <= 1 || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            task(order[i]);
+        }
+        return;
+    }
+
+    // deal round robin, so every worker starts on one of the longest tasks
+    for (int i = 0; i < (int)queues.size(); i++)
+    {
+        queues[i]->tasks.clear();
+        queues[i]->head = 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        queues[i % n]->tasks.push_back(order[i]);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current_task = &task;
+        active_threads = n;
+        remaining = count;
+        busy_workers = (int)queues.size() - 1;
+        generation++;
+    }
+    wakeup.notify_all();
+
+    const int caller_index = g_worker_index;
+    g_worker_index = 0;
+
+    work(0);
+
+    g_worker_index = caller_index;
+
+    // workers still hold a reference to task until they leave work()
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [this]() { return remaining == 0 && busy_workers == 0; });
+    current_task = 0;
+}
+
+void TaskPool::worker(int index)
+{
+    g_worker_index = index;
+
+    int seen_generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeup.wait(guard, [&]() { return stopping || generation != seen_generation; });
+            if (stopping)
+                break;
+
+            seen_generation = generation;
+        }
+
+        work(index);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            busy_workers--;
+        }
+        finished.notify_all();
+    }
+}
+
+bool TaskPool::next_task(int index, int& task)
+{
+    // own deque from the front, longest first
+    {
+        Queue* q = queues[index];
+        std::lock_guard<std::mutex> guard(q->lock);
+        if (q->head < q->tasks.size())
+        {
+            task = q->tasks[q->head++];
+            return true;
+        }
+    }
+
+    // steal the cheapest task of another worker
+    const int n = active_threads;
+    for (int k = 1; k < n; k++)
+    {
+        Queue* q = queues[(index + k) % n];
+        std::lock_guard<std::mutex> guard(q->lock);
+        if (q->head < q->tasks.size())
+        {
+            task = q->tasks.back();
+            q->tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TaskPool::work(int index)
+{
+    // workers past max_threads sit this run out
+    if (index >= active_threads)
+        return;
+
+    const std::function<void(int)>& task = *current_task;
+
+    int i;
+    while (next_task(index, i))
+    {
+        task(i);
+
+        if (--remaining == 0)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            finished.notify_all();
+        }
+    }
+}
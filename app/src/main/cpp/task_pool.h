@@ -0,0 +1,78 @@
+// Copyright 2025 DroidOCR Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent worker threads with one task deque each
+// tasks are dealt out most expensive first, a worker takes the front of its own deque
+// and steals from the back of the others once it runs dry
+class TaskPool
+{
+public:
+    TaskPool();
+    ~TaskPool();
+
+    // num_threads workers including the caller of run()
+    void start(int num_threads);
+    void stop();
+
+    int num_threads() const;
+
+    // task(i) for every i in [0, count), in descending costs[i] order where possible,
+    // on at most max_threads workers (0 for all), blocks until all are done, the caller works too
+    void run(int count, const std::vector<float>& costs, const std::function<void(int)>& task, int max_threads = 0);
+
+    // worker slot of the calling thread in [0, num_threads), 0 outside the pool
+    static int worker_index();
+
+protected:
+    struct Queue
+    {
+        std::mutex lock;
+        std::vector<int> tasks;
+        size_t head;
+    };
+
+    void worker(int index);
+    bool next_task(int index, int& task);
+    void work(int index);
+
+protected:
+    std::vector<std::thread> threads;
+    std::vector<Queue*> queues;
+
+    // serializes run() callers
+    std::mutex run_lock;
+
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+    int generation;
+    bool stopping;
+
+    const std::function<void(int)>* current_task;
+    int active_threads;
+    std::atomic<int> remaining;
+    int busy_workers;
+};
+
+#endif // TASK_POOL_H
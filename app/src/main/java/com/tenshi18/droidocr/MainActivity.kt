@@ -59,6 +59,7 @@ import android.util.Log
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
+import java.io.File
 import java.io.InputStream
 
 class MainActivity : ComponentActivity() {
@@ -118,6 +119,9 @@ class MainActivity : ComponentActivity() {
     private fun loadModel() {
         try {
             val config = languageManager.getCurrentLanguageConfig()
+            ppocrRec.setModelCacheDir(File(cacheDir, "models").absolutePath)
+            // the det warm-up would run here on the main thread, so only rec goes to the background
+            ppocrRec.setModelLoading(backgroundRec = true)
             isModelLoaded = ppocrRec.loadModel(
                 assetManager = assets,
                 detParamPath = "PP_OCRv5_mobile_det.ncnn.param",
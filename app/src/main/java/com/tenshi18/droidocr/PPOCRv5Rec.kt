@@ -22,27 +22,48 @@ import android.graphics.PointF
 
 /**
  * Результат распознавания одного текстового региона
+ * @param skipped регион отброшен фильтром нетекстовых областей и не распознавался
  */
 data class TextRegion(
     val text: String,
     val corners: Array<PointF>,
-    val confidence: Float
+    val confidence: Float,
+    val skipped: Boolean = false
 ) {
     override fun equals(other: Any?): Boolean {
         if (this === other) return true
         if (javaClass != other?.javaClass) return false
         other as TextRegion
-        return text == other.text && corners.contentEquals(other.corners) && confidence == other.confidence
+        return text == other.text && corners.contentEquals(other.corners) && confidence == other.confidence &&
+            skipped == other.skipped
     }
 
     override fun hashCode(): Int {
         var result = text.hashCode()
         result = 31 * result + corners.contentHashCode()
         result = 31 * result + confidence.hashCode()
+        result = 31 * result + skipped.hashCode()
         return result
     }
 }
 
+/**
+ * Источник изображений для пакетного распознавания
+ */
+interface BatchSource {
+    /**
+     * @return следующее изображение или null, если изображений больше нет
+     */
+    fun next(): Bitmap?
+
+    /**
+     * Вызывается по порядку для каждого изображения, после вызова Bitmap можно освободить
+     * @param index номер изображения в порядке выдачи из next()
+     * @param regions найденные текстовые регионы
+     */
+    fun onResult(index: Int, regions: Array<TextRegion>)
+}
+
 /**
  * JNI wrapper для работы с моделью распознавания текста PPOCRv5
  */
@@ -83,6 +104,229 @@ class PPOCRv5Rec {
      */
     external fun detectAndRecognizeWithBoxes(bitmap: Bitmap): Array<TextRegion>
     
+    /**
+     * Конвейерно распознает серию изображений: детекция следующего изображения
+     * идет параллельно с распознаванием строк текущего
+     * @param source источник изображений и приемник результатов, вызывается из потока вызова
+     * @param maxInFlight сколько изображений одновременно держится в обработке
+     * @return количество обработанных изображений
+     */
+    external fun detectAndRecognizeBatch(source: BatchSource, maxInFlight: Int = 2): Int
+    
+    /**
+     * Распознает текст только внутри заданных областей изображения без копирования Bitmap
+     * @param bitmap изображение для распознавания
+     * @param regions области по четыре числа left, top, right, bottom (как android.graphics.Rect)
+     * @return массив найденных текстовых регионов с координатами в системе всего изображения
+     */
+    external fun detectAndRecognizeInRegions(bitmap: Bitmap, regions: IntArray): Array<TextRegion>
+    
+    /**
+     * Включает детекцию по тайлам для больших изображений
+     * Изображение режется на перекрывающиеся тайлы почти в исходном масштабе,
+     * поэтому мелкий текст на фото с высоким разрешением не теряется
+     * @param tileSize размер тайла в пикселях (кратен 32), 0 отключает режим
+     * @param tileOverlap перекрытие соседних тайлов в пикселях
+     */
+    external fun setTiledDetection(tileSize: Int, tileOverlap: Int = 128)
+    
+    /**
+     * Включает двухэтапную детекцию
+     * Быстрый проход в низком разрешении находит области с текстом,
+     * в полном разрешении обрабатываются только тайлы, покрывающие эти области
+     * @param coarseSize размер холста грубого прохода (например 320), 0 отключает режим
+     * @param tileSize размер тайла точного прохода в пикселях
+     */
+    external fun setCoarseToFine(coarseSize: Int, tileSize: Int = 384)
+    
+    /**
+     * Задает параметры постобработки детекции для последующих вызовов
+     * @param threshold порог бинаризации карты текста
+     * @param boxThresh минимальная средняя уверенность региона
+     * @param enlargeRatio коэффициент расширения найденных рамок
+     * @param maxCandidates максимальное число кандидатов
+     */
+    external fun setDetectionParams(
+        threshold: Float = 0.3f,
+        boxThresh: Float = 0.6f,
+        enlargeRatio: Float = 1.95f,
+        maxCandidates: Int = 1000
+    )
+    
+    /**
+     * Запускает детекцию и сохраняет карту текста изображения,
+     * чтобы менять пороги без повторного прогона сети
+     * @param bitmap изображение
+     * @return true если сессия создана
+     */
+    external fun beginDetectionSession(bitmap: Bitmap): Boolean
+    
+    /**
+     * Повторяет постобработку сохраненной карты с новыми порогами и распознает найденные регионы
+     * @param bitmap то же изображение, что и в beginDetectionSession
+     * @return массив найденных текстовых регионов с координатами и текстом
+     */
+    external fun sessionRecognizeWithBoxes(
+        bitmap: Bitmap,
+        threshold: Float,
+        boxThresh: Float,
+        enlargeRatio: Float = 1.95f,
+        maxCandidates: Int = 1000
+    ): Array<TextRegion>
+    
+    /**
+     * Освобождает сохраненную карту текста
+     */
+    external fun endDetectionSession()
+    
+    /**
+     * Включает адаптивный выбор разрешения детекции по размеру текста
+     * Выбирается минимальный холст, на котором основной текст не меньше minTextHeight пикселей;
+     * выбранный размер и причина выбора видны в getStats()
+     * @param mode 0 - выключено (1024), 1 - быстрый предварительный проход, 2 - по предыдущему изображению
+     * @param minTextHeight минимальная высота текста на холсте детекции в пикселях
+     * @param maxSize максимальный размер холста
+     */
+    external fun setAdaptiveDetection(mode: Int, minTextHeight: Float = 16f, maxSize: Int = 2048)
+    
+    /**
+     * Задает набор ширин, до которых дополняются строки перед распознаванием,
+     * чтобы сеть видела несколько постоянных форм входа; попадания и время по каждой ширине видны в getStats()
+     * @param widths ширины для строк высотой 48 пикселей, пустой массив отключает дополнение
+     */
+    external fun setRecognitionWidthBuckets(widths: IntArray)
+    
+    /**
+     * Включает упаковку коротких строк: несколько строк склеиваются по горизонтали
+     * через пустой разделитель и распознаются за один проход сети
+     * @param packWidth ширина склеенного входа в пикселях, 0 отключает упаковку
+     * @param maxLineWidth строки шире этого значения распознаются по отдельности
+     * @param separator ширина пустого разделителя между строками в пикселях
+     */
+    external fun setLinePacking(packWidth: Int, maxLineWidth: Int = 320, separator: Int = 32)
+    
+    /**
+     * Переключает быстрый CTC декодер: декодирование идет по выходу сети до Softmax
+     * с векторным argmax (по умолчанию включено); false возвращает прежний декодер,
+     * время декодирования обоих вариантов видно в getStats()
+     */
+    external fun setFastCtcDecode(enabled: Boolean)
+    
+    /**
+     * Включает распознавание длинных строк по частям: строка шире chunkWidth режется
+     * на перекрывающиеся куски, которые распознаются параллельно и сшиваются по перекрытию
+     * @param chunkWidth ширина куска в пикселях входа сети, 0 отключает
+     * @param overlap ширина перекрытия соседних кусков в пикселях
+     * @param verify дополнительно распознавать строку целиком и считать совпадения в getStats()
+     */
+    external fun setChunkedRecognition(chunkWidth: Int, overlap: Int = 64, verify: Boolean = false)
+    
+    /**
+     * Задает распределение ядер при распознавании строк: параллельно по строкам
+     * или несколько потоков внутри одного прохода сети
+     * @param mode 0 - автоматически по числу и ширине строк, 1 - только по строкам, 2 - все ядра на каждую строку
+     * @param intraMinWidth в автоматическом режиме строки уже этой ширины (в пикселях при высоте 48) идут в один поток
+     */
+    external fun setRecognitionParallelism(mode: Int, intraMinWidth: Int = 192)
+    
+    /**
+     * Выбирает способ вырезания строк для распознавания; время вырезания видно в getStats()
+     * @param interpolation 0 - Lanczos через OpenCV (по умолчанию), 1 - быстрое билинейное ядро,
+     * 2 - быстрое ядро с ближайшим соседом; быстрые ядра сразу пишут нормализованный тензор
+     */
+    external fun setCropInterpolation(interpolation: Int)
+    
+    /**
+     * Включает двухуровневое распознавание: сначала все строки распознаются с дешевым вырезанием,
+     * затем строки со средней уверенностью символов ниже minProb повторно проходят точный путь
+     * (способ из setCropInterpolation); число строк и время каждого уровня видно в getStats()
+     * @param cheapInterpolation способ вырезания для дешевого прохода, значения как в setCropInterpolation
+     */
+    external fun setTwoTierRecognition(enabled: Boolean, minProb: Float = 0.9f, cheapInterpolation: Int = 1)
+    
+    /**
+     * Включает кэш распознанного текста: почти одинаковые вырезанные строки (по перцептивному хэшу)
+     * берут текст из кэша без прохода сети; кэш сбрасывается при смене модели в switchLanguage,
+     * попадания и занятая память видны в getStats()
+     * @param maxKilobytes предельный размер кэша в килобайтах, 0 отключает кэш
+     * @param gridStep ширина ячейки хэша в пикселях; чем больше, тем больше похожих строк совпадает
+     */
+    external fun setRecognitionCache(maxKilobytes: Int, gridStep: Int = 4)
+    
+    /**
+     * Включает фильтр нетекстовых областей перед распознаванием: однотонные вырезки
+     * и вырезки со слишком редкими или слишком частыми перепадами яркости (иконки, текстуры)
+     * не распознаются и помечаются в TextRegion.skipped; число отброшенных видно в getStats()
+     * @param minContrast минимальное СКО яркости (черный-белый = 2)
+     * @param minEdgeDensity минимальная доля пикселей с резким перепадом яркости по горизонтали
+     * @param maxEdgeDensity максимальная доля таких пикселей
+     */
+    external fun setTextFilter(
+        enabled: Boolean,
+        minContrast: Float = 0.1f,
+        minEdgeDensity: Float = 0.02f,
+        maxEdgeDensity: Float = 0.5f
+    )
+    
+    /**
+     * Включает слияние цепочек скалярных BinaryOp (умножение/сложение на константу) со свертками
+     * при загрузке моделей (по умолчанию выключено); применяется при следующем switchLanguage,
+     * число слоев до и после и среднее время прохода сети видны в getStats();
+     * совпадение выходов с исходными моделями проверяет fusion_check.py
+     */
+    external fun setGraphFusion(enabled: Boolean)
+    
+    /**
+     * Задает каталог для кэша подготовленных моделей: после первой загрузки объединенные
+     * веса сохраняются в fp32 и при следующих запусках отображаются в память без повторной обработки;
+     * работает только при включенном setGraphFusion, вызывается до loadModel, попадания видны в getStats()
+     * @param path каталог в личном хранилище приложения, пустая строка отключает кэш
+     */
+    external fun setModelCacheDir(path: String)
+    
+    /**
+     * Задает способ загрузки моделей; вызывается до loadModel/switchLanguage.
+     * Детекция и распознавание всегда загружаются параллельно
+     * @param backgroundRec loadModel возвращается сразу после загрузки детекции, модель распознавания
+     * догружается в фоне, а распознавание ждет ее готовности (состояние видно в getModelState)
+     * @param warmUp прогнать обе сети на входах типичного размера сразу после загрузки,
+     * чтобы первое распознавание не платило за выделение памяти
+     */
+    external fun setModelLoading(backgroundRec: Boolean, warmUp: Boolean = false)
+    
+    /**
+     * Возвращает состояние сети: -1 - ошибка загрузки, 0 - не загружена, 1 - загружается,
+     * 2 - прогрев, 3 - готова
+     * @param net 0 - детекция, 1 - распознавание
+     */
+    external fun getModelState(net: Int): Int
+    
+    /**
+     * Задает точность вычислений отдельно для детекции и распознавания; применяется при следующем switchLanguage.
+     * Для int8 рядом с моделью должна лежать квантованная версия с суффиксом _int8
+     * (PP_OCRv5_mobile_det_int8.ncnn.param/.bin, см. calibrate_int8.sh), без нее сеть работает в fp16;
+     * фактическая точность и размер весов видны в getStats()
+     * @param detPrecision -1 - по умолчанию (fp16), 0 - fp32, 1 - fp16, 2 - int8, другие значения - по умолчанию
+     * @param recPrecision то же для распознавания
+     */
+    external fun setPrecision(detPrecision: Int, recPrecision: Int)
+    
+    /**
+     * Задает порог отбрасывания вложенных и сильно перекрывающихся рамок перед распознаванием
+     * @param overlap доля площади меньшей рамки, накрытая большей (по умолчанию 0.8), 0 отключает
+     */
+    external fun setDedupOverlap(overlap: Float)
+    
+    /**
+     * Возвращает накопленную статистику работы движка (ключ=значение, по строке на счётчик)
+     */
+    external fun getStats(): String
+    
+    /**
+     * Сбрасывает накопленную статистику
+     */
+    external fun resetStats()
+    
     /**
      * Переключает язык распознавания
      * Освобождает текущую модель и загружает новую
@@ -0,0 +1,80 @@
+#!/bin/bash
+
+# Builds int8 variants of the det and rec models from your own images
+#
+#   ./calibrate_int8.sh <det_images_dir> <rec_crops_dir> [rec_model_name]
+#
+# det_images_dir - full photos/screenshots like the ones the app will see
+# rec_crops_dir  - cropped text lines (any height, they are scaled to 48 px)
+# rec_model_name - rec model in app/src/main/assets, eslav_ppocrv5_rec by default
+#
+# The quantized models are written next to the float ones with an _int8 suffix
+# (PP_OCRv5_mobile_det_int8.ncnn.param/.bin) and picked up by setPrecision(2, 2)
+# Set NCNN_TOOLS to a directory with ncnn2table and ncnn2int8 to skip the download
+
+set -e
+
+NCNN_VERSION="20250916"
+NCNN_URL="https://github.com/Tencent/ncnn/releases/download/${NCNN_VERSION}/ncnn-${NCNN_VERSION}-ubuntu-2404.zip"
+ASSETS_DIR="app/src/main/assets"
+WORK_DIR="build/int8"
+
+DET_IMAGES="$1"
+REC_CROPS="$2"
+DET_MODEL="PP_OCRv5_mobile_det"
+REC_MODEL="${3:-eslav_ppocrv5_rec}"
+
+if [ ! -d "${DET_IMAGES}" ] || [ ! -d "${REC_CROPS}" ]; then
+    echo "Usage: $0 <det_images_dir> <rec_crops_dir> [rec_model_name]"
+    exit 1
+fi
+
+mkdir -p ${WORK_DIR}
+
+if [ -z "${NCNN_TOOLS}" ]; then
+    NCNN_TOOLS="${WORK_DIR}/ncnn-${NCNN_VERSION}-ubuntu-2404/bin"
+    if [ ! -x "${NCNN_TOOLS}/ncnn2table" ]; then
+        echo "Downloading ncnn ${NCNN_VERSION} tools from ${NCNN_URL}..."
+        wget -O ${WORK_DIR}/ncnn-tools.zip ${NCNN_URL}
+        unzip -q -o ${WORK_DIR}/ncnn-tools.zip -d ${WORK_DIR}
+        rm ${WORK_DIR}/ncnn-tools.zip
+    fi
+fi
+
+list_images() {
+    find "$1" -type f \( -iname '*.jpg' -o -iname '*.jpeg' -o -iname '*.png' -o -iname '*.bmp' \) | sort > "$2"
+    echo "$(wc -l < "$2") calibration images in $1"
+}
+
+# quantize <model> <imagelist> <mean> <norm> <shape>
+quantize() {
+    local model=$1
+    echo ""
+    echo "Calibrating ${model}..."
+    ${NCNN_TOOLS}/ncnn2table \
+        ${ASSETS_DIR}/${model}.ncnn.param ${ASSETS_DIR}/${model}.ncnn.bin \
+        $2 ${WORK_DIR}/${model}.table \
+        mean=$3 norm=$4 shape=$5 pixel=RGB thread=$(nproc) method=kl
+    ${NCNN_TOOLS}/ncnn2int8 \
+        ${ASSETS_DIR}/${model}.ncnn.param ${ASSETS_DIR}/${model}.ncnn.bin \
+        ${ASSETS_DIR}/${model}_int8.ncnn.param ${ASSETS_DIR}/${model}_int8.ncnn.bin \
+        ${WORK_DIR}/${model}.table
+}
+
+list_images "${DET_IMAGES}" ${WORK_DIR}/det_images.txt
+list_images "${REC_CROPS}" ${WORK_DIR}/rec_crops.txt
+
+# same normalization as PPOCRv5::forward_det and the rec input
+quantize ${DET_MODEL} ${WORK_DIR}/det_images.txt \
+    [123.675,116.28,103.53] [0.017125,0.017507,0.017429] [960,960,3]
+quantize ${REC_MODEL} ${WORK_DIR}/rec_crops.txt \
+    [127.5,127.5,127.5] [0.007843,0.007843,0.007843] [320,48,3]
+
+echo ""
+echo "Model sizes:"
+ls -l ${ASSETS_DIR}/${DET_MODEL}*.bin ${ASSETS_DIR}/${REC_MODEL}*.bin
+
+echo ""
+echo "Accuracy and latency of the int8 models against the float ones:"
+python3 int8_report.py --det-images "${DET_IMAGES}" --rec-crops "${REC_CROPS}" --rec-model ${REC_MODEL} \
+    || echo "int8_report.py needs python3 with numpy, opencv-python and ncnn (pip install ncnn)"
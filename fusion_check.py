@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+
+# Checks that the fused det and rec models give the same outputs as the originals:
+# det heatmap and rec output differences, and rec argmax agreement per time step
+#
+#   adb exec-out run-as com.tenshi18.droidocr tar c cache/models | tar x -C build
+#   python3 fusion_check.py --fused-dir build/cache/models [--det-images photos/ --rec-crops lines/]
+#
+# The fused models are the ones the app writes to its model cache with graph fusion on
+# (setGraphFusion(true) and setModelCacheDir), named <model>.ncnn.bin.<key>.param/.bin
+# Without images the nets run on random inputs. Both sides run in fp32,
+# so any difference comes from the fusion and not from fp16 storage
+#
+# Needs numpy, opencv-python and ncnn (pip install ncnn)
+
+import argparse
+import glob
+import os
+import sys
+
+import cv2
+import ncnn
+import numpy as np
+
+IMAGE_EXTS = (".jpg", ".jpeg", ".png", ".bmp")
+
+DET_MEAN = [0.485 * 255, 0.456 * 255, 0.406 * 255]
+DET_NORM = [1 / 0.229 / 255, 1 / 0.224 / 255, 1 / 0.225 / 255]
+REC_MEAN = [127.5, 127.5, 127.5]
+REC_NORM = [1 / 127.5, 1 / 127.5, 1 / 127.5]
+
+
+def load_net(param, model):
+    net = ncnn.Net()
+    net.opt.use_fp16_packed = False
+    net.opt.use_fp16_storage = False
+    net.opt.use_fp16_arithmetic = False
+    net.opt.num_threads = 1
+    net.load_param(param)
+    net.load_model(model)
+    return net
+
+
+def fused_paths(fused_dir, model):
+    params = sorted(glob.glob(os.path.join(fused_dir, model + ".ncnn.bin.*.param")))
+    if not params:
+        sys.exit("no fused %s in %s, run the app once with graph fusion and the model cache on" % (model, fused_dir))
+    return params[-1], params[-1][:-len(".param")] + ".bin"
+
+
+def forward(net, mat):
+    ex = net.create_extractor()
+    ex.input("in0", mat)
+    _, out = ex.extract("out0")
+    return np.array(out)
+
+
+def image_mat(image, size, mean, norm):
+    h, w = image.shape[:2]
+    mat = ncnn.Mat.from_pixels_resize(image, ncnn.Mat.PixelType.PIXEL_BGR2RGB, w, h, size[0], size[1])
+    mat.substract_mean_normalize(mean, norm)
+    return mat
+
+
+def random_mat(rng, w, h):
+    # normalized pixels are about in [-2, 2]
+    return ncnn.Mat(rng.uniform(-2.0, 2.0, (3, h, w)).astype(np.float32))
+
+
+def list_images(directory):
+    if not directory:
+        return []
+    return sorted(os.path.join(directory, n) for n in os.listdir(directory) if n.lower().endswith(IMAGE_EXTS))
+
+
+def det_size(image, target_size):
+    # longer side to target_size, both sides a multiple of 32 like the app canvas
+    h, w = image.shape[:2]
+    scale = target_size / max(w, h)
+    return max(32, int(round(w * scale / 32)) * 32), max(32, int(round(h * scale / 32)) * 32)
+
+
+def det_inputs(args, rng):
+    mats = []
+    for path in list_images(args.det_images):
+        image = cv2.imread(path)
+        mats.append(image_mat(image, det_size(image, args.target_size), DET_MEAN, DET_NORM))
+    if mats:
+        return mats
+    return [random_mat(rng, w, h) for w, h in ((640, 480), (480, 640), (960, 704))]
+
+
+def rec_inputs(args, rng):
+    crops = list_images(args.rec_crops)
+    mats = []
+    for path in crops:
+        image = cv2.imread(path)
+        h, w = image.shape[:2]
+        mats.append(image_mat(image, (max(8, int(round(w * 48 / h / 8)) * 8), 48), REC_MEAN, REC_NORM))
+    if mats:
+        return mats
+    return [random_mat(rng, w, 48) for w in (160, 320, 640)]
+
+
+def compare(name, original, fused, inputs, argmax):
+    worst = 0.0
+    agreed = 0
+    steps = 0
+    for mat in inputs:
+        a = forward(original, mat)
+        b = forward(fused, mat)
+        if a.shape != b.shape:
+            print("%s: output shape %s vs %s" % (name, a.shape, b.shape))
+            return float("inf"), 0.0
+        worst = max(worst, float(np.abs(a - b).max()))
+        if argmax:
+            ids_a = a.reshape(-1, a.shape[-1]).argmax(axis=1)
+            ids_b = b.reshape(-1, b.shape[-1]).argmax(axis=1)
+            agreed += int((ids_a == ids_b).sum())
+            steps += len(ids_a)
+
+    return worst, agreed / max(steps, 1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="fused vs original PP-OCRv5 outputs")
+    parser.add_argument("--fused-dir", required=True)
+    parser.add_argument("--det-images")
+    parser.add_argument("--rec-crops")
+    parser.add_argument("--assets", default="app/src/main/assets")
+    parser.add_argument("--det-model", default="PP_OCRv5_mobile_det")
+    parser.add_argument("--rec-model", default="eslav_ppocrv5_rec")
+    parser.add_argument("--target-size", type=int, default=1024)
+    parser.add_argument("--tolerance", type=float, default=1e-3)
+    args = parser.parse_args()
+
+    rng = np.random.default_rng(0)
+    failed = False
+
+    for model, inputs, argmax in ((args.det_model, det_inputs(args, rng), False), (args.rec_model, rec_inputs(args, rng), True)):
+        base = os.path.join(args.assets, model + ".ncnn")
+        original = load_net(base + ".param", base + ".bin")
+        fused = load_net(*fused_paths(args.fused_dir, model))
+
+        worst, agreement = compare(model, original, fused, inputs, argmax)
+        ok = worst <= args.tolerance
+        failed = failed or not ok
+
+        line = "%-24s %d inputs, max abs diff %.3g" % (model, len(inputs), worst)
+        if argmax:
+            line += ", argmax agreement %.4f" % agreement
+        print(line + ("" if ok else "  FAIL (tolerance %g)" % args.tolerance))
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
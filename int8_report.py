@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+
+# Compares the int8 models made by calibrate_int8.sh with the float ones:
+# det recall/precision, rec CER, host latency and model size
+#
+#   python3 int8_report.py --det-images photos/ --rec-crops lines/
+#
+# Ground truth is optional and uses the PaddleOCR label formats:
+#   <det-images>/Label.txt  - name<TAB>[{"transcription": "...", "points": [[x, y], ...]}, ...]
+#   <rec-crops>/rec_gt.txt  - name<TAB>text
+# Without it the float model output is the reference, so the numbers show
+# how much int8 disagrees with fp32 rather than absolute accuracy
+#
+# Needs numpy, opencv-python and ncnn (pip install ncnn)
+
+import argparse
+import json
+import os
+import time
+
+import cv2
+import ncnn
+import numpy as np
+
+IMAGE_EXTS = (".jpg", ".jpeg", ".png", ".bmp")
+
+DET_MEAN = [0.485 * 255, 0.456 * 255, 0.406 * 255]
+DET_NORM = [1 / 0.229 / 255, 1 / 0.224 / 255, 1 / 0.225 / 255]
+REC_MEAN = [127.5, 127.5, 127.5]
+REC_NORM = [1 / 127.5, 1 / 127.5, 1 / 127.5]
+
+
+def load_net(param, model, int8, threads):
+    net = ncnn.Net()
+    net.opt.use_int8_inference = int8
+    net.opt.num_threads = threads
+    net.load_param(param)
+    net.load_model(model)
+    return net
+
+
+def forward(net, image, size, mean, norm):
+    h, w = image.shape[:2]
+    mat = ncnn.Mat.from_pixels_resize(image, ncnn.Mat.PixelType.PIXEL_BGR2RGB, w, h, size[0], size[1])
+    mat.substract_mean_normalize(mean, norm)
+
+    start = time.perf_counter()
+    ex = net.create_extractor()
+    ex.input("in0", mat)
+    _, out = ex.extract("out0")
+    elapsed = (time.perf_counter() - start) * 1000
+
+    return np.array(out), elapsed
+
+
+def det_size(image, target_size):
+    # longer side to target_size, both sides a multiple of 32 like the app canvas
+    h, w = image.shape[:2]
+    scale = target_size / max(w, h)
+    return max(32, int(round(w * scale / 32)) * 32), max(32, int(round(h * scale / 32)) * 32)
+
+
+def det_boxes(heatmap, image_size, threshold=0.3, box_thresh=0.6):
+    heatmap = heatmap.reshape(heatmap.shape[-2:])
+    sx = image_size[0] / heatmap.shape[1]
+    sy = image_size[1] / heatmap.shape[0]
+
+    contours, _ = cv2.findContours((heatmap > threshold).astype(np.uint8), cv2.RETR_LIST, cv2.CHAIN_APPROX_SIMPLE)
+
+    boxes = []
+    for contour in contours:
+        if len(contour) < 4:
+            continue
+
+        mask = np.zeros(heatmap.shape, np.uint8)
+        cv2.fillPoly(mask, [contour], 1)
+        if cv2.mean(heatmap, mask)[0] < box_thresh:
+            continue
+
+        # db unclip of the shrunk region
+        (cx, cy), (w, h), angle = cv2.minAreaRect(contour)
+        if min(w, h) < 3:
+            continue
+        d = w * h * 1.5 / (2 * (w + h))
+        rect = ((cx * sx, cy * sy), ((w + 2 * d) * sx, (h + 2 * d) * sy), angle)
+        boxes.append(cv2.boxPoints(rect).astype(np.float32))
+
+    return boxes
+
+
+def iou(a, b):
+    inter, _ = cv2.intersectConvexConvex(a, b)
+    union = cv2.contourArea(a) + cv2.contourArea(b) - inter
+    return inter / union if union > 0 else 0.0
+
+
+def match(boxes, reference, min_iou=0.5):
+    # greedy one to one matches of boxes against reference
+    used = set()
+    matched = 0
+    for r in reference:
+        best, best_iou = -1, min_iou
+        for i, b in enumerate(boxes):
+            if i not in used:
+                v = iou(b, r)
+                if v >= best_iou:
+                    best, best_iou = i, v
+        if best >= 0:
+            used.add(best)
+            matched += 1
+    return matched
+
+
+def ctc_decode(out, dictionary):
+    ids = out.reshape(-1, out.shape[-1]).argmax(axis=1)
+    chars = []
+    prev = 0
+    for i in ids:
+        if i != 0 and i != prev and i - 1 < len(dictionary):
+            chars.append(dictionary[i - 1])
+        prev = i
+    return "".join(chars)
+
+
+def edit_distance(a, b):
+    row = list(range(len(b) + 1))
+    for i in range(1, len(a) + 1):
+        prev, row[0] = row[0], i
+        for j in range(1, len(b) + 1):
+            prev, row[j] = row[j], min(row[j] + 1, row[j - 1] + 1, prev + (a[i - 1] != b[j - 1]))
+    return row[len(b)]
+
+
+def read_labels(path):
+    labels = {}
+    if os.path.exists(path):
+        with open(path, encoding="utf-8") as f:
+            for line in f:
+                name, _, value = line.rstrip("\n").partition("\t")
+                labels[os.path.basename(name)] = value
+    return labels
+
+
+def list_images(directory):
+    return sorted(os.path.join(directory, n) for n in os.listdir(directory) if n.lower().endswith(IMAGE_EXTS))
+
+
+def model_paths(assets, name, int8):
+    base = os.path.join(assets, name + ("_int8" if int8 else "") + ".ncnn")
+    return base + ".param", base + ".bin"
+
+
+def evaluate_det(args):
+    labels = read_labels(os.path.join(args.det_images, "Label.txt"))
+    nets = [load_net(*model_paths(args.assets, args.det_model, int8), int8, args.threads) for int8 in (False, True)]
+
+    results = [{"matched": 0, "found": 0, "reference": 0, "time": 0.0} for _ in nets]
+    images = list_images(args.det_images)
+    for path in images:
+        image = cv2.imread(path)
+        h, w = image.shape[:2]
+
+        boxes = []
+        for net, r in zip(nets, results):
+            out, elapsed = forward(net, image, det_size(image, args.target_size), DET_MEAN, DET_NORM)
+            boxes.append(det_boxes(out, (w, h)))
+            r["time"] += elapsed
+
+        name = os.path.basename(path)
+        if name in labels:
+            reference = [np.array(o["points"], np.float32) for o in json.loads(labels[name])]
+        else:
+            reference = boxes[0]
+
+        for found, r in zip(boxes, results):
+            r["matched"] += match(found, reference)
+            r["found"] += len(found)
+            r["reference"] += len(reference)
+
+    return results, len(images), len(labels) > 0
+
+
+def evaluate_rec(args):
+    labels = read_labels(os.path.join(args.rec_crops, "rec_gt.txt"))
+    with open(os.path.join(args.assets, args.dict), encoding="utf-8") as f:
+        dictionary = [line.rstrip("\r\n") for line in f if line.rstrip("\r\n")]
+    nets = [load_net(*model_paths(args.assets, args.rec_model, int8), int8, args.threads) for int8 in (False, True)]
+
+    results = [{"errors": 0, "chars": 0, "time": 0.0} for _ in nets]
+    crops = list_images(args.rec_crops)
+    for path in crops:
+        image = cv2.imread(path)
+        h, w = image.shape[:2]
+        size = (max(8, int(round(w * 48 / h / 8)) * 8), 48)
+
+        texts = []
+        for net, r in zip(nets, results):
+            out, elapsed = forward(net, image, size, REC_MEAN, REC_NORM)
+            texts.append(ctc_decode(out, dictionary))
+            r["time"] += elapsed
+
+        reference = labels.get(os.path.basename(path), texts[0])
+        for text, r in zip(texts, results):
+            r["errors"] += edit_distance(text, reference)
+            r["chars"] += max(len(reference), 1)
+
+    return results, len(crops), len(labels) > 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="int8 vs float PP-OCRv5 report")
+    parser.add_argument("--det-images", required=True)
+    parser.add_argument("--rec-crops", required=True)
+    parser.add_argument("--assets", default="app/src/main/assets")
+    parser.add_argument("--det-model", default="PP_OCRv5_mobile_det")
+    parser.add_argument("--rec-model", default="eslav_ppocrv5_rec")
+    parser.add_argument("--dict", default="ppocrv5_eslav_dict.txt")
+    parser.add_argument("--target-size", type=int, default=1024)
+    parser.add_argument("--threads", type=int, default=4)
+    args = parser.parse_args()
+
+    det, det_count, det_gt = evaluate_det(args)
+    rec, rec_count, rec_gt = evaluate_rec(args)
+
+    print("det on %d images against %s" % (det_count, "Label.txt" if det_gt else "fp32 boxes"))
+    print("rec on %d crops against %s" % (rec_count, "rec_gt.txt" if rec_gt else "fp32 text"))
+    print("")
+    print("%-6s %8s %10s %8s %10s %10s %10s" % ("", "recall", "precision", "CER", "det ms", "rec ms", "size KB"))
+
+    for i, precision in enumerate(("fp32", "int8")):
+        d, r = det[i], rec[i]
+        size = sum(os.path.getsize(model_paths(args.assets, m, i == 1)[1]) for m in (args.det_model, args.rec_model))
+        print("%-6s %8.4f %10.4f %8.4f %10.2f %10.2f %10d" % (
+            precision,
+            d["matched"] / max(d["reference"], 1),
+            d["matched"] / max(d["found"], 1),
+            r["errors"] / max(r["chars"], 1),
+            d["time"] / max(det_count, 1),
+            r["time"] / max(rec_count, 1),
+            size // 1024))
+
+    print("")
+    print("host latency only ranks the two, measure on the device with getStats()")
+
+
+if __name__ == "__main__":
+    main()